@@ -0,0 +1,119 @@
+#include "batch_generator.h"
+#include "common_modules.h"
+#include "forward_declare.h"
+#include "hogwild_trainer.h"
+#include "modules/module_dense.h"
+#include "node.h"
+#include "optimizer.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+using namespace snnl;
+
+// Compares the training throughput of the usual synchronous loop, where only
+// the connectors run in parallel, with Hogwild training on 1, 2, 4, ... workers
+
+struct SparseModel : public Module<float>
+{
+    DenseModuleShPtr<float> dense1;
+    DenseModuleShPtr<float> dense2;
+
+    SparseModel()
+    {
+        dense1 = addModule<DenseModule>(256, 32);
+        dense2 = addModule<DenseModule>(32, 1);
+    }
+
+    virtual NodeShPtr<float> callHandler(std::vector<NodeShPtr<float>> input) override
+    {
+        return dense2->call(Sigmoid(dense1->call(input)));
+    }
+};
+
+NodeShPtr<float> lossFunction(Module<float>& model, std::vector<NodeShPtr<float>> batch)
+{
+    return MSE(model.call(batch.at(0)), batch.at(1));
+}
+
+int main()
+{
+    size_t num_samples = 8192;
+    size_t batch_size  = 16;
+    size_t num_steps   = 2000;
+    float  rate        = 0.05;
+
+    // Sparse inputs: Each sample activates 8 of 256 features
+    Tensor<float> x({num_samples, size_t(256)});
+    Tensor<float> y({num_samples, size_t(1)});
+    Tensor<float> feature_weights({256});
+    feature_weights.uniform();
+
+    std::mt19937_64                       rng(42);
+    std::uniform_int_distribution<size_t> feature(0, 255);
+    for(size_t i = 0; i < num_samples; i++) {
+        for(size_t k = 0; k < 8; k++) {
+            size_t j = feature(rng);
+            x(i, j)  = 1;
+            y(i, 0) += feature_weights(j);
+        }
+    }
+
+    auto evaluate = [&](SparseModel& model) {
+        return lossFunction(model, {Node<float>::create(x), Node<float>::create(y)})->value();
+    };
+
+    auto seconds_since = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::cout << std::setw(20) << "mode" << std::setw(16) << "samples/s" << std::setw(12)
+              << "loss" << std::endl;
+
+    {
+        SparseModel         model;
+        SGDOptimizer<float> optimizer(rate);
+        BatchGenerator      generator(x, y);
+        generator.mute();
+
+        auto start = std::chrono::steady_clock::now();
+        for(size_t step = 0; step < num_steps; step++) {
+            auto [input, target] = generator.generateBatch(batch_size);
+            auto loss            = lossFunction(model, {input, target});
+            loss->computeGrad();
+            optimizer.optimizeStep(loss);
+        }
+        double seconds = seconds_since(start);
+
+        std::cout << std::setw(20) << "synchronous" << std::setw(16)
+                  << num_steps * batch_size / seconds << std::setw(12) << evaluate(model)
+                  << std::endl;
+    }
+
+    for(size_t num_workers = 1; num_workers <= numThreads(); num_workers *= 2) {
+        SparseModel           model;
+        HogwildTrainer<float> trainer(
+            model,
+            [] {
+                return std::make_shared<SparseModel>();
+            },
+            num_workers, lossFunction, rate);
+
+        std::vector<BatchGenerator<float, 2>> generators;
+        for(size_t i = 0; i < num_workers; i++) {
+            generators.emplace_back(x, y);
+            generators.back().mute();
+            generators.back().setSeed(i);
+        }
+
+        // Same number of samples in total as the synchronous loop
+        auto start = std::chrono::steady_clock::now();
+        trainer.train(generators, batch_size, num_steps / num_workers);
+        double seconds = seconds_since(start);
+
+        std::cout << std::setw(20) << "hogwild x" + std::to_string(num_workers) << std::setw(16)
+                  << num_steps / num_workers * num_workers * batch_size / seconds
+                  << std::setw(12) << evaluate(model) << std::endl;
+    }
+}
@@ -0,0 +1,72 @@
+#include "idx_reader.h"
+#include "sharded_dataset.h"
+#include "tensor.h"
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace snnl;
+
+// Converts pairs of IDX files with byte values, e.g. the MNIST images and
+// labels, into sharded data sets, or indexes shards written by separate jobs.
+//
+// make_shards write <index> <records per shard> <images> <labels>
+// make_shards index <index> <shard> [<shard> ...]
+//
+// The shards of a data set are read with ShardedDataset<uint8_t, 2>.
+
+int usage()
+{
+    std::cerr << "Usage: make_shards write <index> <records per shard> <images> <labels>\n"
+              << "       make_shards index <index> <shard> [<shard> ...]" << std::endl;
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if(args.size() < 3) {
+        return usage();
+    }
+
+    try {
+        if(args[0] == "write" && args.size() == 5) {
+            Tensor<uint8_t> images = readIDX<uint8_t>(args[3]);
+            Tensor<uint8_t> labels = readIDX<uint8_t>(args[4]);
+            if(images.shape(0) != labels.shape(0)) {
+                throw std::domain_error("Number of images and labels differs");
+            }
+
+            // Every image is one sample, every label a single value
+            std::vector<size_t> image_shape;
+            for(long d = 1; d < images.NDims(); d++) {
+                image_shape.push_back(images.shape(d));
+            }
+            ShardedDatasetWriter<uint8_t, 2> writer(args[1], {image_shape, {1}},
+                                                    std::stoul(args[2]));
+            writer.write({images, labels.viewAs({labels.shape(0), size_t(1)})});
+            writer.close();
+
+            ShardedDataset<uint8_t, 2> dataset(args[1]);
+            std::cout << "Wrote " << dataset.numSamples() << " samples into "
+                      << dataset.numShards() << " shards" << std::endl;
+        }
+        else if(args[0] == "index") {
+            writeShardIndex(args[1], std::vector<std::string>(args.begin() + 2, args.end()));
+
+            ShardedDataset<uint8_t, 2> dataset(args[1]);
+            std::cout << "Indexed " << dataset.numSamples() << " samples in "
+                      << dataset.numShards() << " shards" << std::endl;
+        }
+        else {
+            return usage();
+        }
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
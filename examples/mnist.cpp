@@ -1,105 +1,40 @@
+#include "async_evaluator.h"
 #include "batch_generator.h"
+#include "batch_prefetcher.h"
 #include "common_modules.h"
 #include "connectors/connector_cross_entropy.h"
 #include "connectors/connector_softmax.h"
 #include "forward_declare.h"
+#include "idx_reader.h"
 #include "modules/module_dense.h"
 #include "node.h"
 #include "optimizer.h"
 #include "statistics.h"
 #include "tensor.h"
 #include <cmath>
-#include <fstream>
 #include <stdexcept>
 
 using namespace snnl;
 
-Tensor<float> read_mnist_images(std::string full_path)
+// Images with a trailing channel axis, multiplied by scale
+template<class TElem>
+Tensor<TElem> read_mnist_images(std::string full_path, TElem scale = 1)
 {
-    auto reverseInt = [](int i) {
-        unsigned char c1, c2, c3, c4;
-        c1 = i & 255, c2 = (i >> 8) & 255, c3 = (i >> 16) & 255, c4 = (i >> 24) & 255;
-        return ((int)c1 << 24) + ((int)c2 << 16) + ((int)c3 << 8) + c4;
-    };
-
-    int number_of_images, image_size;
-
-    typedef unsigned char uchar;
-
-    std::ifstream file(full_path, std::ios::binary);
-
-    if(file.is_open()) {
-        int magic_number = 0, n_rows = 0, n_cols = 0;
-
-        file.read((char*)&magic_number, sizeof(magic_number));
-        magic_number = reverseInt(magic_number);
-
-        if(magic_number != 2051) {
-            throw std::runtime_error("Invalid MNIST image file!");
-        }
-
-        file.read((char*)&number_of_images, sizeof(number_of_images)),
-            number_of_images = reverseInt(number_of_images);
-        file.read((char*)&n_rows, sizeof(n_rows)), n_rows = reverseInt(n_rows);
-        file.read((char*)&n_cols, sizeof(n_cols)), n_cols = reverseInt(n_cols);
-
-        image_size = n_rows * n_cols;
-
-        Tensor<float> out = {number_of_images, n_rows, n_cols, 1};
-        uchar         image[image_size];
-        for(int i = 0; i < number_of_images; i++) {
-            file.read((char*)image, image_size);
-            for(size_t row = 0; row < size_t(n_rows); row++) {
-                for(size_t col = 0; col < size_t(n_cols); col++) {
-                    out(i, row, col, 0) = image[col + n_cols * row];
-                }
-            }
-        }
-        return out;
-    }
-    else {
-        throw std::runtime_error("Cannot open file `" + full_path + "`!");
+    Tensor<TElem> images = readIDX<TElem>(full_path, scale);
+    if(images.NDims() != 3) {
+        throw std::runtime_error("Invalid MNIST image file!");
     }
+    return images.viewAs({images.shape(0), images.shape(1), images.shape(2), size_t(1)});
 }
 
-Tensor<float> read_mnist_labels(std::string full_path)
+template<class TElem>
+Tensor<TElem> read_mnist_labels(std::string full_path)
 {
-    auto reverseInt = [](int i) {
-        unsigned char c1, c2, c3, c4;
-        c1 = i & 255, c2 = (i >> 8) & 255, c3 = (i >> 16) & 255, c4 = (i >> 24) & 255;
-        return ((int)c1 << 24) + ((int)c2 << 16) + ((int)c3 << 8) + c4;
-    };
-
-    typedef unsigned char uchar;
-    int                   number_of_labels;
-
-    std::ifstream file(full_path, std::ios::binary);
-
-    if(file.is_open()) {
-        int magic_number = 0;
-        file.read((char*)&magic_number, sizeof(magic_number));
-        magic_number = reverseInt(magic_number);
-
-        if(magic_number != 2049) {
-            throw std::runtime_error("Invalid MNIST label file!");
-        }
-
-        file.read((char*)&number_of_labels, sizeof(number_of_labels)),
-            number_of_labels = reverseInt(number_of_labels);
-
-        std::vector<uchar> data(number_of_labels);
-        for(int i = 0; i < number_of_labels; i++) {
-            file.read((char*)&data[i], 1);
-        }
-        Tensor<float> out{number_of_labels};
-        for(int i = 0; i < number_of_labels; i++) {
-            out(i) = data[i];
-        }
-        return out;
-    }
-    else {
-        throw std::runtime_error("Unable to open file `" + full_path + "`!");
+    Tensor<TElem> labels = readIDX<TElem>(full_path);
+    if(labels.NDims() != 1) {
+        throw std::runtime_error("Invalid MNIST label file!");
     }
+    return labels;
 }
 
 struct MNistModel : public Module<float>
@@ -153,17 +88,17 @@ int main()
 {
     // You need to extract the mnist data and put them into the root folder of the repo
     // (Assuming you work at snnl/build)
-    auto train_images = read_mnist_images("../train-images.idx3-ubyte");
-    train_images /= 255.f;
-    train_images.saveToBMP("train.bmp", 0, 1);
+    // The training set stays in its compact uint8 form. The batches are
+    // converted and scaled to [0, 1] while they are assembled
+    auto train_images = read_mnist_images<uint8_t>("../train-images.idx3-ubyte");
+    train_images.saveToBMP("train.bmp");
 
-    auto train_labels = read_mnist_labels("../train-labels.idx1-ubyte");
+    auto train_labels = read_mnist_labels<uint8_t>("../train-labels.idx1-ubyte");
 
-    auto test_images = read_mnist_images("../t10k-images.idx3-ubyte");
-    test_images /= 255.f;
+    auto test_images = read_mnist_images<float>("../t10k-images.idx3-ubyte", 1.f / 255);
     test_images.saveToBMP("test.bmp", 0, 1);
 
-    auto test_labels = read_mnist_labels("../t10k-labels.idx1-ubyte");
+    auto test_labels = read_mnist_labels<float>("../t10k-labels.idx1-ubyte");
 
     size_t image_height = train_images.shape(1);
     size_t image_width  = train_images.shape(2);
@@ -175,9 +110,27 @@ int main()
 
     AdamOptimizer<float> optimizer;
 
-    BatchGenerator train_generator(train_images, train_labels);
+    using TrainGenerator = BatchGenerator<float, 2, uint8_t>;
+
+    TrainGenerator train_generator(train_images, train_labels);
     BatchGenerator test_generator(test_images, test_labels);
     test_generator.mute();
+    train_generator.setNormalization(0, {1.f / 255}, {0.f});
+
+    // Evaluates a snapshot of the weights on the test set in the background,
+    // while the training goes on
+    AsyncEvaluator<float, ClassificationMetrics<float>> test_evaluator(
+        model,
+        [&] {
+            return std::make_shared<MNistModel>(image_height, image_width);
+        },
+        test_images, test_labels, ClassificationMetrics<float>(10, 3),
+        [](size_t epoch, const ClassificationMetrics<float>& test_metrics) {
+            std::cout << "Test accuracy after epoch " << epoch << " = " << test_metrics.accuracy()
+                      << ", top 3 accuracy = " << test_metrics.topKAccuracy()
+                      << ", loss = " << test_metrics.meanLoss() << std::endl;
+        },
+        500);
 
     float loss_sum = 0;
 
@@ -202,9 +155,7 @@ int main()
             single_image->values().saveToBMP(std::to_string(predicted) + ".bmp", 0, 1);
         }
 
-        auto   test_encodings = model.call(test_images);
-        double test_accuracy  = sparseAccuracy(test_encodings, test_labels);
-        std::cout << "Test accuracy = " << test_accuracy << std::endl;
+        test_evaluator.start(epoch);
 
         // auto   train_encodings = model.call(train_images);
         // double train_accuracy  = sparseAccuracy(train_encodings, train_labels);
@@ -214,9 +165,12 @@ int main()
         loss_sum = 0;
     });
 
+    // The next batches are assembled while the model trains
+    BatchPrefetcher<float, 2, TrainGenerator> train_batches(train_generator, batch_size);
+
     for(size_t step = 0; step < 100000; step++) {
 
-        auto [input_images, input_labels] = train_generator.generateBatch(batch_size);
+        auto [input_images, input_labels] = train_batches.nextBatch();
 
         NodeShPtr<float> predicted_encodings = model.call(input_images, input_labels);
 
@@ -0,0 +1,205 @@
+#pragma once
+#include "evaluator.h"
+#include "forward_declare.h"
+#include "module.h"
+#include "node.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Evaluates a model in the background while the training goes on. start takes a
+snapshot of the weights by copying them into a replica made by make_replica,
+matched by insertion order like in the DataParallelTrainer. It returns right
+away. A background thread evaluates the snapshot with an Evaluator on an own
+pool of num_threads threads, so the global pool stays with the training. Then
+it passes the metrics to the callback on the background thread, e.g.
+
+AsyncEvaluator<float, ClassificationMetrics<float>> test_evaluator(
+    model,
+    [] {
+        return std::make_shared<MNistModel>(28, 28);
+    },
+    test_images, test_labels, ClassificationMetrics<float>(10),
+    [](size_t epoch, const ClassificationMetrics<float>& metrics) {
+        std::cout << "Test accuracy after epoch " << epoch << " = " << metrics.accuracy()
+                  << std::endl;
+    });
+
+train_generator.setEpochCallBack([&](size_t epoch) {
+    test_evaluator.start(epoch);
+});
+
+One evaluation runs at a time. If the last one is not done yet, start waits for
+it before it takes the next snapshot. Exceptions of the evaluation or the
+callback are rethrown by the next call of start or wait.
+*/
+template<typename TElem, typename TMetrics>
+class AsyncEvaluator
+{
+public:
+    using Callback = std::function<void(size_t, const TMetrics&)>;
+
+private:
+    ModuleShPtr<TElem>            _snapshot;
+    std::vector<NodeShPtr<TElem>> _weights;
+    std::vector<NodeShPtr<TElem>> _snapshot_weights;
+
+    Tensor<TElem> _inputs;
+    Tensor<TElem> _labels;
+    TMetrics      _metrics;
+    Callback      _callback;
+
+    ThreadPool       _pool;
+    Evaluator<TElem> _evaluator;
+
+    size_t                  _tag     = 0;
+    bool                    _pending = false;
+    bool                    _running = false;
+    bool                    _stop    = false;
+    std::exception_ptr      _error;
+    std::mutex              _mutex;
+    std::condition_variable _condition;
+    std::thread             _worker;
+
+    void run()
+    {
+        while(true) {
+            size_t tag;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [&] {
+                    return _stop || _pending;
+                });
+                if(!_pending) {
+                    return;
+                }
+                _pending = false;
+                _running = true;
+                tag      = _tag;
+            }
+
+            // The snapshot is not touched by start while running is set
+            std::exception_ptr error;
+            try {
+                _callback(tag, _evaluator.evaluate(_inputs, _labels, _metrics));
+            }
+            catch(...) {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = false;
+                if(error && !_error) {
+                    _error = error;
+                }
+            }
+            _condition.notify_all();
+        }
+    }
+
+    // Wait until no evaluation is pending or running. Needs the lock
+    void waitIdle(std::unique_lock<std::mutex>& lock)
+    {
+        _condition.wait(lock, [&] {
+            return !_pending && !_running;
+        });
+        if(_error) {
+            std::exception_ptr error = _error;
+            _error                   = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+public:
+    AsyncEvaluator(Module<TElem>& model, std::function<ModuleShPtr<TElem>()> make_replica,
+                   const Tensor<TElem>& inputs, const Tensor<TElem>& labels,
+                   const TMetrics& metrics, Callback callback, size_t batch_size = 256,
+                   size_t num_threads = 2)
+        : _snapshot(make_replica())
+        , _weights(model.weightsSortedByInsertion())
+        , _snapshot_weights(_snapshot->weightsSortedByInsertion())
+        , _inputs(inputs)
+        , _labels(labels)
+        , _metrics(metrics)
+        , _callback(callback)
+        , _pool(num_threads)
+        , _evaluator(*_snapshot, batch_size, &_pool)
+    {
+        if(_weights.size() != _snapshot_weights.size()) {
+            throw std::invalid_argument("AsyncEvaluator: Replica differs in its number of weights");
+        }
+        for(size_t w = 0; w < _weights.size(); w++) {
+            if(_weights[w]->shape() != _snapshot_weights[w]->shape()) {
+                throw std::invalid_argument(
+                    "AsyncEvaluator: Weight shapes of the replica differ: " +
+                    _snapshot_weights[w]->shape() + " vs. " + _weights[w]->shape());
+            }
+        }
+
+        _worker = std::thread(&AsyncEvaluator::run, this);
+    }
+
+    AsyncEvaluator(const AsyncEvaluator&) = delete;
+
+    // Finishes a running evaluation, pending ones are dropped
+    ~AsyncEvaluator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop    = true;
+            _pending = false;
+        }
+        _condition.notify_all();
+        _worker.join();
+    }
+
+    // Snapshot the current weights and evaluate them in the background. tag is
+    // passed on to the callback, e.g. the epoch
+    void start(size_t tag)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        waitIdle(lock);
+
+        for(size_t w = 0; w < _weights.size(); w++) {
+            const Tensor<TElem>& values = _weights[w]->values();
+            Tensor<TElem>&       target = _snapshot_weights[w]->values();
+            if(values.isContiguous() && target.isContiguous()) {
+                std::copy_n(values.data(), values.NElems(), target.data());
+            }
+            else {
+                target = values;
+            }
+        }
+
+        _tag     = tag;
+        _pending = true;
+        _condition.notify_all();
+    }
+
+    // Block until the last evaluation and its callback are done
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        waitIdle(lock);
+    }
+
+    bool busy()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _pending || _running;
+    }
+};
+
+} // namespace snnl
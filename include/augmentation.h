@@ -0,0 +1,171 @@
+#pragma once
+#include "forward_declare.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Random augmentation of batches of images in NHWC layout, i.e. of shape
+{batch, height, width, channels}. Enabled steps run in this order: horizontal
+flip, random crop of the zero padded image, translation with repeated border
+pixels, cutout of a square and Gaussian noise.
+
+The images are split among the threads. Every image draws from its own random
+stream, derived from the seed and its index in the batch, so the result does
+not depend on the number of threads. Attach it to a BatchGenerator to run it
+while the batch is assembled, e.g. on the worker of a BatchPrefetcher:
+
+ImageAugmentation<float> augmentation;
+augmentation.setHorizontalFlip(0.5);
+augmentation.setRandomCrop(4);
+train_generator.setAugmentation(0, augmentation);
+*/
+template<class TElem>
+class ImageAugmentation
+{
+    TElem  _flip_probability = 0;
+    size_t _crop_padding     = 0;
+    size_t _max_translation  = 0;
+    size_t _cutout_size      = 0;
+    TElem  _noise_stddev     = 0;
+
+    // Shift the image by (dy, dx). Pixels from outside are zero or the nearest
+    // border pixel
+    static void shift(TElem* image, TElem* scratch, long height, long width, long channels,
+                      long dy, long dx, bool clamp)
+    {
+        std::copy_n(image, height * width * channels, scratch);
+
+        for(long y = 0; y < height; y++) {
+            long   source_y = std::clamp(y + dy, 0l, height - 1);
+            TElem* row      = image + y * width * channels;
+            if(!clamp && source_y != y + dy) {
+                std::fill_n(row, width * channels, TElem(0));
+                continue;
+            }
+            const TElem* source_row = scratch + source_y * width * channels;
+
+            // Columns [x_begin, x_end) are inside of the source image
+            long x_begin = std::clamp(-dx, 0l, width);
+            long x_end   = std::clamp(width - dx, 0l, width);
+            std::copy(source_row + (x_begin + dx) * channels, source_row + (x_end + dx) * channels,
+                      row + x_begin * channels);
+
+            for(long x = 0; x < width; x++) {
+                if(x >= x_begin && x < x_end) {
+                    continue;
+                }
+                if(clamp) {
+                    long source_x = std::clamp(x + dx, 0l, width - 1);
+                    std::copy_n(source_row + source_x * channels, channels, row + x * channels);
+                }
+                else {
+                    std::fill_n(row + x * channels, channels, TElem(0));
+                }
+            }
+        }
+    }
+
+    void augmentImage(TElem* image, TElem* scratch, long height, long width, long channels,
+                      std::mt19937_64& rng) const
+    {
+        if(_flip_probability > 0 &&
+           std::uniform_real_distribution<TElem>(0, 1)(rng) < _flip_probability)
+        {
+            for(long y = 0; y < height; y++) {
+                TElem* row = image + y * width * channels;
+                for(long x = 0; x < width / 2; x++) {
+                    std::swap_ranges(row + x * channels, row + (x + 1) * channels,
+                                     row + (width - 1 - x) * channels);
+                }
+            }
+        }
+
+        auto random_shift = [&](size_t max_shift) {
+            return std::uniform_int_distribution<long>(-long(max_shift), max_shift)(rng);
+        };
+
+        if(_crop_padding > 0) {
+            long dy = random_shift(_crop_padding);
+            long dx = random_shift(_crop_padding);
+            shift(image, scratch, height, width, channels, dy, dx, false);
+        }
+
+        if(_max_translation > 0) {
+            long dy = random_shift(_max_translation);
+            long dx = random_shift(_max_translation);
+            shift(image, scratch, height, width, channels, dy, dx, true);
+        }
+
+        if(_cutout_size > 0) {
+            // The square may reach over the border
+            long center_y = std::uniform_int_distribution<long>(0, height - 1)(rng);
+            long center_x = std::uniform_int_distribution<long>(0, width - 1)(rng);
+            long y_begin  = std::max(center_y - long(_cutout_size) / 2, 0l);
+            long x_begin  = std::max(center_x - long(_cutout_size) / 2, 0l);
+            long y_end    = std::min(y_begin + long(_cutout_size), height);
+            long x_end    = std::min(x_begin + long(_cutout_size), width);
+            for(long y = y_begin; y < y_end; y++) {
+                std::fill(image + (y * width + x_begin) * channels,
+                          image + (y * width + x_end) * channels, TElem(0));
+            }
+        }
+
+        if(_noise_stddev > 0) {
+            std::normal_distribution<TElem> noise(0, _noise_stddev);
+            for(long i = 0; i < height * width * channels; i++) {
+                image[i] += noise(rng);
+            }
+        }
+    }
+
+public:
+    // Mirror the image along its width with the given probability
+    void setHorizontalFlip(TElem probability) { _flip_probability = probability; }
+
+    // Pad the image with padding zeros on every side and crop an image of the
+    // original size at a random position
+    void setRandomCrop(size_t padding) { _crop_padding = padding; }
+
+    // Shift the image by up to max_shift pixels along both axes, repeating the
+    // pixels at the border
+    void setTranslation(size_t max_shift) { _max_translation = max_shift; }
+
+    // Set a square of size x size pixels at a random position to zero
+    void setCutout(size_t size) { _cutout_size = size; }
+
+    // Add Gaussian noise with the given standard deviation to every value
+    void setNoise(TElem stddev) { _noise_stddev = stddev; }
+
+    void operator()(Tensor<TElem>& batch, uint64_t seed) const
+    {
+        if(batch.NDims() != 4 || !batch.isContiguous()) {
+            throw std::invalid_argument("ImageAugmentation: Need a contiguous NHWC batch, got " +
+                                        batch.shape());
+        }
+        long height     = batch.shape(1);
+        long width      = batch.shape(2);
+        long channels   = batch.shape(3);
+        long image_size = height * width * channels;
+
+        TElem* images = batch.data();
+
+        parallelFor(0, batch.shape(0), [&](size_t image_begin, size_t image_end) {
+            std::vector<TElem> scratch(image_size);
+            for(size_t image = image_begin; image < image_end; image++) {
+                std::seed_seq   seeds{uint32_t(seed), uint32_t(seed >> 32), uint32_t(image)};
+                std::mt19937_64 rng(seeds);
+                augmentImage(images + image * image_size, scratch.data(), height, width,
+                             channels, rng);
+            }
+        });
+    }
+};
+
+} // namespace snnl
@@ -1,114 +1,210 @@
 #pragma once
+#include "batch_generator_base.h"
 #include "forward_declare.h"
 #include "node.h"
+#include "random_permutation.h"
 #include "tensor.h"
+#include "thread_pool.h"
 #include <stdexcept>
+#include <type_traits>
 
 namespace snnl
 {
-template<typename TElem, size_t NumTensors>
-class BatchGenerator
+
+/*
+Draws random batches from data sets held in memory. The data may be stored in
+a more compact type TStorage, e.g. uint8_t for images, which is converted to
+TElem while the batch is assembled. A scale and offset per channel (the last
+axis) can be applied at the same time, e.g.
+
+Tensor<uint8_t> images = readIDX<uint8_t>("train-images.idx3-ubyte");
+Tensor<uint8_t> labels = readIDX<uint8_t>("train-labels.idx1-ubyte");
+
+BatchGenerator<float, 2, uint8_t> generator(images, labels);
+generator.setNormalization(0, {1.f / 255}, {0});
+
+Samples may also be windows of a series without copying them, e.g. to predict
+the step after each window of 64 steps of a series {steps, features}
+
+long          num_steps = series.shape(0);
+Tensor<float> inputs    = series.viewAs(range(0, num_steps - 1), all()).slidingWindows(64, 8);
+Tensor<float> targets   = series.viewAs(range(64, num_steps), all()).slidingWindows(1, 8);
+BatchGenerator<float, 2> generator(inputs, targets);
+*/
+template<typename TElem, size_t NumTensors, typename TStorage = TElem>
+class BatchGenerator : public BatchGeneratorBase<TElem, NumTensors>
 {
-    std::array<Tensor<TElem>, NumTensors> _data;
+    std::array<Tensor<TStorage>, NumTensors> _data;
 
-    std::vector<size_t> _shuffled_indices;
-    size_t              _epoch_size;
-    size_t              _current_index = 0;
-    size_t              _epoch_counter = 0;
-    size_t              _epoch         = 0;
-    bool                _mute          = false;
+    // Scale and offset of every element of a sample. Empty if the values are
+    // only converted
+    std::array<std::vector<TElem>, NumTensors> _scales;
+    std::array<std::vector<TElem>, NumTensors> _offsets;
 
-    std::function<void(size_t)> _epoch_callback = [](size_t epoch) {
-        std::cout << "Reaching epoch " + std::to_string(epoch) << std::endl;
-    };
+    // Called with each assembled batch of a tensor and a random seed
+    std::array<std::function<void(Tensor<TElem>&, uint64_t)>, NumTensors> _augmentations;
 
-    std::mt19937_64 _rng;
+    // Order of the samples in the current pass over the data
+    RandomPermutation _permutation;
+    size_t            _current_index = 0;
 
-    void reshuffle()
+    virtual void reshuffle() override
     {
-        std::shuffle(_shuffled_indices.begin(), _shuffled_indices.end(), _rng);
+        _permutation.setKey(this->_rng());
         _current_index = 0;
     }
 
+    size_t sampleSize(size_t i) const { return _data[i].NElems() / _data[i].shape(0); }
+
+    // Rows of the data with the given indices, converted and augmented into
+    // the batch
+    virtual void gather(const std::vector<size_t>&             indices,
+                        std::array<Tensor<TElem>*, NumTensors> batch) override
+    {
+        for(size_t i = 0; i < NumTensors; i++) {
+            convert(indices, i, *batch[i]);
+            if(_augmentations[i]) {
+                _augmentations[i](*batch[i], this->_rng());
+            }
+        }
+    }
+
+    void convert(const std::vector<size_t>& indices, size_t i, Tensor<TElem>& out)
+    {
+        if constexpr(std::is_same_v<TElem, TStorage>) {
+            if(_scales[i].empty()) {
+                _data[i].gatherRows(indices, out);
+                return;
+            }
+        }
+
+        size_t row_size = sampleSize(i);
+        if(out.shape(0) != indices.size() || out.NElems() != indices.size() * row_size ||
+           !out.isContiguous())
+        {
+            throw std::invalid_argument("BatchGenerator: Batch tensor of shape " + out.shape() +
+                                        " does not fit the samples");
+        }
+
+        const TStorage* source     = _data[i].data();
+        size_t          row_stride = _data[i].stride(0);
+        TElem*          target     = out.data();
+        const TElem*    scale      = _scales[i].data();
+        const TElem*    offset     = _offsets[i].data();
+        bool            normalize  = !_scales[i].empty();
+
+        // Scale and offset are expanded to whole rows, so that the loops
+        // vectorize
+        parallelFor(
+            0, indices.size(),
+            [&](size_t row_begin, size_t row_end) {
+                for(size_t row = row_begin; row < row_end; row++) {
+                    const TStorage* row_in  = source + indices[row] * row_stride;
+                    TElem*          row_out = target + row * row_size;
+                    if(normalize) {
+                        for(size_t j = 0; j < row_size; j++) {
+                            row_out[j] = static_cast<TElem>(row_in[j]) * scale[j] + offset[j];
+                        }
+                    }
+                    else {
+                        for(size_t j = 0; j < row_size; j++) {
+                            row_out[j] = static_cast<TElem>(row_in[j]);
+                        }
+                    }
+                }
+            },
+            PARALLEL_GRAIN_SIZE / std::max(row_size, size_t(1)));
+    }
+
+    // A new pass starts after all samples and after every epoch
+    virtual std::vector<size_t> nextIndices(size_t batch_size) override
+    {
+        std::vector<size_t> indices(batch_size);
+
+        for(size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+            indices[batch_index] = _permutation(_current_index);
+
+            _current_index++;
+            if(_current_index >= _permutation.size()) {
+                reshuffle();
+            }
+            if(this->countSample()) {
+                reshuffle();
+            }
+        }
+        return indices;
+    }
+
 public:
     template<typename... TArgs>
     BatchGenerator(TArgs... args)
         : _data{args...}
-        , _rng(time(NULL))
     {
         for(size_t i = 0; i < _data.size(); i++) {
             if(_data[0].shape(0) != _data[i].shape(0)) {
                 throw std::domain_error("Dimensions of tensors mismatch");
             }
         }
-        _shuffled_indices.resize(_data[0].shape(0));
-        for(size_t i = 0; i < _shuffled_indices.size(); i++) {
-            _shuffled_indices[i] = i;
+        if(_data[0].shape(0) == 0) {
+            throw std::domain_error("BatchGenerator: No samples");
+        }
+        for(auto& data : _data) {
+            // Gathers read whole rows. Rows at any distance, e.g. overlapping
+            // windows, are used in place
+            if(!data.rowsContiguous()) {
+                data.shareDataWith(data.copy());
+            }
         }
-        _epoch_size = _shuffled_indices.size();
+        _permutation = RandomPermutation(_data[0].shape(0), 0);
+        this->setNumSamples(_permutation.size());
 
         reshuffle();
     }
 
-    std::array<NodeShPtr<TElem>, NumTensors> generateBatch(size_t batch_size)
+    virtual std::array<Tensor<TElem>, NumTensors> allocateBatch(size_t batch_size) const override
     {
-        std::array<NodeShPtr<TElem>, NumTensors> out;
+        std::array<Tensor<TElem>, NumTensors> out;
 
         for(size_t i = 0; i < NumTensors; i++) {
             auto shape_out = _data[i].shape();
             shape_out[0]   = batch_size;
 
-            auto batch = Node<TElem>::create(shape_out);
-            out[i]     = batch;
-        }
-
-        for(size_t batch_index = 0; batch_index < batch_size; batch_index++) {
-
-            for(size_t i = 0; i < NumTensors; i++) {
-                out[i]->values().viewAs(batch_index, ellipsis()) =
-                    _data[i].viewAs(_shuffled_indices[_current_index], ellipsis());
-            }
-
-            _current_index++;
-            _epoch_counter++;
-
-            if(_current_index >= _shuffled_indices.size()) {
-                reshuffle();
-            }
-            if(_epoch_counter >= _epoch_size) {
-                _epoch++;
-                if(not _mute) {
-                    _epoch_callback(_epoch);
-                }
-                _epoch_counter = 0;
-                reshuffle();
-            }
+            out[i] = Tensor<TElem>(shape_out);
         }
         return out;
     }
 
-    void setEpochSize(size_t epoch_size)
+    // Convert the values x of tensor i to x * scale[c] + offset[c] in every
+    // batch, where c is the index along the last axis. scale and offset hold
+    // one value per channel or a single one for all
+    void setNormalization(size_t i, const std::vector<TElem>& scale,
+                          const std::vector<TElem>& offset)
     {
-        if(epoch_size == 0) {
-            throw std::domain_error("Invalid epoch size 0");
+        size_t channels = _data.at(i).NDims() > 1 ? _data[i].shape(-1) : 1;
+        for(auto& values : {scale, offset}) {
+            if(values.size() != 1 && values.size() != channels) {
+                throw std::invalid_argument("BatchGenerator: Need 1 or " +
+                                            std::to_string(channels) +
+                                            " values for scale and offset, got " +
+                                            std::to_string(values.size()));
+            }
         }
-        else {
-            _epoch_size = epoch_size;
+
+        size_t row_size = sampleSize(i);
+        _scales[i].resize(row_size);
+        _offsets[i].resize(row_size);
+        for(size_t j = 0; j < row_size; j++) {
+            _scales[i][j]  = scale[scale.size() == 1 ? 0 : j % channels];
+            _offsets[i][j] = offset[offset.size() == 1 ? 0 : j % channels];
         }
     }
-    void setEpochCallBack(std::function<void(size_t)> epoch_callback)
-    {
-        _epoch_callback = epoch_callback;
-    }
 
-    void reset()
+    // Modify every batch of tensor i after it is assembled, e.g. with an
+    // ImageAugmentation. augmentation gets the batch and a random seed
+    void setAugmentation(size_t i, std::function<void(Tensor<TElem>&, uint64_t)> augmentation)
     {
-        reshuffle();
-        _epoch         = 0;
-        _epoch_counter = 0;
+        _augmentations.at(i) = augmentation;
     }
-
-    void mute() { _mute = true; }
 };
 
 template<typename... TArgs>
@@ -0,0 +1,169 @@
+#pragma once
+#include "forward_declare.h"
+#include "node.h"
+#include "tensor.h"
+#include <array>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Bookkeeping shared by the batch generators: Counting epochs, the epoch
+callback and handing out batches as nodes. A generator decides the order of
+the samples in nextIndices and copies them into a batch in gather.
+*/
+template<typename TElem, size_t NumTensors>
+class BatchGeneratorBase
+{
+    size_t _epoch_size    = 0;
+    size_t _epoch_counter = 0;
+    size_t _epoch         = 0;
+    bool   _mute          = false;
+
+    std::function<void(size_t)> _epoch_callback = [](size_t epoch) {
+        std::cout << "Reaching epoch " + std::to_string(epoch) << std::endl;
+    };
+
+    // Nodes of the last batch, reused by the next one if enabled and possible
+    std::array<NodeShPtr<TElem>, NumTensors> _batch;
+    bool                                     _reuse_batches = false;
+
+protected:
+    std::mt19937_64 _rng;
+
+    BatchGeneratorBase()
+        : _rng(time(NULL))
+    {
+    }
+
+    // Indices of the next batch_size samples. Calls countSample for each
+    virtual std::vector<size_t> nextIndices(size_t batch_size) = 0;
+
+    // Copy the samples with the given indices into the tensors of a batch
+    virtual void gather(const std::vector<size_t>&             indices,
+                        std::array<Tensor<TElem>*, NumTensors> batch) = 0;
+
+    // Start a new pass over the samples
+    virtual void reshuffle() = 0;
+
+    // Epochs span num_samples samples until setEpochSize is called
+    void setNumSamples(size_t num_samples) { _epoch_size = num_samples; }
+
+    // Count a sample handed out. Returns true if it completed an epoch, after
+    // the epoch callback was called
+    bool countSample()
+    {
+        _epoch_counter++;
+        if(_epoch_counter < _epoch_size) {
+            return false;
+        }
+
+        _epoch++;
+        if(not _mute) {
+            _epoch_callback(_epoch);
+        }
+        _epoch_counter = 0;
+        return true;
+    }
+
+public:
+    virtual ~BatchGeneratorBase() = default;
+
+    // Tensors holding batch_size samples
+    virtual std::array<Tensor<TElem>, NumTensors> allocateBatch(size_t batch_size) const = 0;
+
+    // Returns new nodes, or with setReuseBatches the nodes of the last call if
+    // nobody else holds them anymore
+    std::array<NodeShPtr<TElem>, NumTensors> generateBatch(size_t batch_size)
+    {
+        bool reuse = _reuse_batches;
+        for(auto& node : _batch) {
+            reuse &= node && node.use_count() == 1 && node->shape(0) == batch_size;
+        }
+        if(!reuse) {
+            auto tensors = allocateBatch(batch_size);
+            for(size_t i = 0; i < NumTensors; i++) {
+                _batch[i] = Node<TElem>::create(tensors[i]);
+            }
+        }
+
+        std::array<Tensor<TElem>*, NumTensors> values;
+        for(size_t i = 0; i < NumTensors; i++) {
+            values[i] = &_batch[i]->values();
+        }
+        gather(nextIndices(batch_size), values);
+        return _batch;
+    }
+
+    // Write the next samples into existing tensors, e.g. from allocateBatch.
+    // The batch size is the first dimension of the tensors
+    void fillBatch(std::array<Tensor<TElem>, NumTensors>& batch)
+    {
+        std::array<Tensor<TElem>*, NumTensors> values;
+        for(size_t i = 0; i < NumTensors; i++) {
+            values[i] = &batch[i];
+        }
+        gather(nextIndices(batch[0].shape(0)), values);
+    }
+
+    /*
+    Let generateBatch hand out the nodes of the last batch again, once no other
+    pointer to them is left, e.g. after the graph of the last step is gone. Only
+    their values are overwritten, which saves the allocation of every batch.
+
+    Tensors taken from a batch share its values, so they change with the next
+    batch as well. Copy them to keep them:
+
+    Tensor<float> x = batch[0]->values().copy();
+
+    Any other state set on the nodes, e.g. a gradient, is kept as well.
+    */
+    void setReuseBatches(bool reuse_batches)
+    {
+        _reuse_batches = reuse_batches;
+        if(!reuse_batches) {
+            _batch = {};
+        }
+    }
+
+    void setEpochSize(size_t epoch_size)
+    {
+        if(epoch_size == 0) {
+            throw std::domain_error("Invalid epoch size 0");
+        }
+        _epoch_size = epoch_size;
+    }
+
+    void setEpochCallBack(std::function<void(size_t)> epoch_callback)
+    {
+        _epoch_callback = epoch_callback;
+    }
+
+    const std::function<void(size_t)>& epochCallBack() const { return _epoch_callback; }
+
+    void reset()
+    {
+        reshuffle();
+        _epoch         = 0;
+        _epoch_counter = 0;
+    }
+
+    void mute() { _mute = true; }
+
+    // Generators created within the same second share their seed. Set distinct
+    // seeds if they should draw different batches
+    void setSeed(size_t seed)
+    {
+        _rng.seed(seed);
+        reset();
+    }
+};
+
+} // namespace snnl
@@ -0,0 +1,175 @@
+#pragma once
+#include "batch_generator.h"
+#include "forward_declare.h"
+#include "node.h"
+#include "tensor.h"
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Assembles the batches of a BatchGenerator on a background thread, so that the
+copies of the samples run while the model trains on the current batch. The
+worker fills up to num_prefetch batches ahead into a ring of preallocated
+buffers, which are reused for the whole run. e.g.
+
+BatchGenerator            train_generator(train_images, train_labels);
+BatchPrefetcher<float, 2> prefetcher(train_generator, 32, 2);
+
+auto [images, labels] = prefetcher.nextBatch();
+
+The nodes of a batch share the memory of their buffer. They are valid until the
+next call of nextBatch, which hands the buffer back to the worker.
+
+Works with every generator offering allocateBatch and fillBatch, e.g. the
+MappedBatchGenerator. The generator must not be used elsewhere while the
+prefetcher exists. Its epoch callback is still called on the thread calling
+nextBatch, right before the batch which completed the epoch is returned.
+*/
+template<typename TElem, size_t NumTensors,
+         typename TGenerator = BatchGenerator<TElem, NumTensors>>
+class BatchPrefetcher
+{
+    using Batch = std::array<Tensor<TElem>, NumTensors>;
+
+    TGenerator&                 _generator;
+    std::function<void(size_t)> _epoch_callback;
+
+    // Ring of buffers and the epochs completed while filling each of them
+    std::vector<Batch>               _buffers;
+    std::vector<std::vector<size_t>> _epochs;
+
+    size_t _next_fill = 0;
+    size_t _next_read = 0;
+    size_t _num_ready = 0;
+    bool   _holding   = false;
+    bool   _stop      = false;
+
+    std::exception_ptr      _error;
+    std::mutex              _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _free;
+    std::thread             _worker;
+
+    void run()
+    {
+        while(true) {
+            size_t slot;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _free.wait(lock, [&] {
+                    return _stop || _num_ready + _holding < _buffers.size();
+                });
+                if(_stop) {
+                    return;
+                }
+                slot = _next_fill;
+            }
+
+            // The worker owns the slot until it is marked as ready
+            try {
+                _epochs[slot].clear();
+                _generator.fillBatch(_buffers[slot]);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _error = std::current_exception();
+                _ready.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _next_fill = (slot + 1) % _buffers.size();
+                _num_ready++;
+            }
+            _ready.notify_all();
+        }
+    }
+
+public:
+    BatchPrefetcher(TGenerator& generator, size_t batch_size, size_t num_prefetch = 2)
+        : _generator(generator)
+        , _epoch_callback(generator.epochCallBack())
+    {
+        if(batch_size == 0 || num_prefetch == 0) {
+            throw std::invalid_argument(
+                "BatchPrefetcher: Batch size and number of prefetched batches must not be 0");
+        }
+
+        // One more buffer than prefetched batches for the batch in use
+        for(size_t i = 0; i < num_prefetch + 1; i++) {
+            _buffers.push_back(generator.allocateBatch(batch_size));
+        }
+        _epochs.resize(_buffers.size());
+
+        // Only the worker changes _next_fill while it runs
+        _generator.setEpochCallBack([this](size_t epoch) {
+            _epochs[_next_fill].push_back(epoch);
+        });
+
+        _worker = std::thread(&BatchPrefetcher::run, this);
+    }
+
+    BatchPrefetcher(const BatchPrefetcher&) = delete;
+
+    ~BatchPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _free.notify_all();
+        _worker.join();
+
+        _generator.setEpochCallBack(_epoch_callback);
+    }
+
+    size_t batchSize() const { return _buffers[0][0].shape(0); }
+
+    // Number of batches assembled ahead of the current one
+    size_t numPrefetch() const { return _buffers.size() - 1; }
+
+    std::array<NodeShPtr<TElem>, NumTensors> nextBatch()
+    {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if(_holding) {
+                _holding   = false;
+                _next_read = (_next_read + 1) % _buffers.size();
+                _free.notify_all();
+            }
+
+            _ready.wait(lock, [&] {
+                return _num_ready > 0 || _error;
+            });
+            if(_num_ready == 0) {
+                std::rethrow_exception(_error);
+            }
+            _num_ready--;
+            _holding = true;
+            slot     = _next_read;
+        }
+
+        for(size_t epoch : _epochs[slot]) {
+            _epoch_callback(epoch);
+        }
+
+        std::array<NodeShPtr<TElem>, NumTensors> out;
+        for(size_t i = 0; i < NumTensors; i++) {
+            out[i] = Node<TElem>::create(_buffers[slot][i]);
+        }
+        return out;
+    }
+};
+
+} // namespace snnl
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace snnl
+{
+
+// Code of the element type T in the headers of binary files, the same as in
+// IDX files
+template<typename T>
+constexpr uint32_t idxTypeCode()
+{
+    if constexpr(std::is_same_v<T, uint8_t>) {
+        return 0x08;
+    }
+    else if constexpr(std::is_same_v<T, int8_t>) {
+        return 0x09;
+    }
+    else if constexpr(std::is_same_v<T, int16_t>) {
+        return 0x0B;
+    }
+    else if constexpr(std::is_same_v<T, int32_t>) {
+        return 0x0C;
+    }
+    else if constexpr(std::is_same_v<T, float>) {
+        return 0x0D;
+    }
+    else {
+        static_assert(std::is_same_v<T, double>, "Unsupported element type");
+        return 0x0E;
+    }
+}
+
+// Write value in native byte order
+template<typename T>
+void writeBinaryValue(std::ostream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Reads values one after another out of a header, checking the bounds
+class BinaryHeaderReader
+{
+    const uint8_t*     _data;
+    size_t             _size;
+    size_t             _position = 0;
+    const std::string& _path;
+
+public:
+    BinaryHeaderReader(const uint8_t* data, size_t size, const std::string& path)
+        : _data(data)
+        , _size(size)
+        , _path(path)
+    {}
+
+    template<typename T>
+    T read()
+    {
+        if(_position + sizeof(T) > _size) {
+            throw std::runtime_error("Truncated header in " + _path);
+        }
+        T value;
+        std::memcpy(&value, _data + _position, sizeof(T));
+        _position += sizeof(T);
+        return value;
+    }
+
+    std::string readString(size_t length)
+    {
+        if(_position + length > _size) {
+            throw std::runtime_error("Truncated header in " + _path);
+        }
+        std::string value(reinterpret_cast<const char*>(_data) + _position, length);
+        _position += length;
+        return value;
+    }
+
+    size_t position() const { return _position; }
+};
+
+} // namespace snnl
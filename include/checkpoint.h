@@ -0,0 +1,263 @@
+#pragma once
+#include "binary_io.h"
+#include "forward_declare.h"
+#include "mapped_file.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Checkpoints of named tensors, e.g. the weights of a module. The header starts
+with
+
+char     magic[8]   "SNNLCKPT"
+uint32_t version
+uint32_t type       Type of the elements, with the type codes of IDX files
+uint32_t alignment  Of the data of every tensor
+uint32_t num_tensors
+
+followed for every tensor by
+
+uint32_t length of the name, then the name
+uint32_t number of dimensions, then uint64_t per dimension
+uint64_t offset of the data from the start of the file
+uint64_t checksum of the data
+
+All values are in native byte order. The data of a tensor is written in one
+piece straight from its memory. Loading maps the file and copies every tensor
+once from the page cache into its target, while the checksum is verified.
+*/
+constexpr uint32_t CHECKPOINT_VERSION   = 1;
+constexpr size_t   CHECKPOINT_ALIGNMENT = 64;
+
+namespace checkpoint_detail
+{
+
+// FNV-1a over 64 bit words, then over the remaining bytes
+inline uint64_t checksum(const uint8_t* data, size_t size)
+{
+    constexpr uint64_t prime = 0x100000001b3;
+
+    uint64_t hash  = 0xcbf29ce484222325;
+    size_t   words = size / sizeof(uint64_t);
+    for(size_t w = 0; w < words; w++) {
+        uint64_t word;
+        std::memcpy(&word, data + w * sizeof(uint64_t), sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+    }
+    for(size_t b = words * sizeof(uint64_t); b < size; b++) {
+        hash = (hash ^ data[b]) * prime;
+    }
+    return hash;
+}
+
+inline size_t alignedOffset(size_t offset)
+{
+    return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+} // namespace checkpoint_detail
+
+struct CheckpointEntry
+{
+    std::string name;
+    Index       shape;
+    uint64_t    offset;
+    uint64_t    checksum;
+};
+
+struct CheckpointHeader
+{
+    uint32_t                     type;
+    uint32_t                     alignment;
+    std::vector<CheckpointEntry> entries;
+};
+
+inline bool isCheckpoint(const MappedFile& file)
+{
+    return file.size() >= 8 && std::memcmp(file.data(), "SNNLCKPT", 8) == 0;
+}
+
+inline CheckpointHeader readCheckpointHeader(const MappedFile& file, const std::string& path)
+{
+    BinaryHeaderReader reader(file.data(), file.size(), path);
+    if(reader.readString(8) != "SNNLCKPT") {
+        throw std::runtime_error(path + " is no checkpoint");
+    }
+    if(uint32_t version = reader.read<uint32_t>(); version != CHECKPOINT_VERSION) {
+        throw std::runtime_error("Unsupported checkpoint version " + std::to_string(version) +
+                                 " in " + path);
+    }
+
+    CheckpointHeader header;
+    header.type      = reader.read<uint32_t>();
+    header.alignment = reader.read<uint32_t>();
+    header.entries.resize(reader.read<uint32_t>());
+    for(auto& entry : header.entries) {
+        entry.name = reader.readString(reader.read<uint32_t>());
+        entry.shape = Index(size_t(reader.read<uint32_t>()));
+        for(size_t& dim : entry.shape) {
+            dim = reader.read<uint64_t>();
+        }
+        entry.offset   = reader.read<uint64_t>();
+        entry.checksum = reader.read<uint64_t>();
+    }
+    return header;
+}
+
+// Write the tensors under their names. The file is written next to path first
+// and renamed when it is complete, so an interrupted write keeps the last
+// checkpoint
+template<typename TElem>
+void writeCheckpoint(const std::string& path, const std::vector<std::string>& names,
+                     const std::vector<Tensor<TElem>>& tensors)
+{
+    if(names.size() != tensors.size()) {
+        throw std::invalid_argument("writeCheckpoint: Got " + std::to_string(names.size()) +
+                                    " names for " + std::to_string(tensors.size()) +
+                                    " tensors");
+    }
+
+    std::vector<Tensor<TElem>> contiguous(tensors);
+    std::vector<uint64_t>      checksums(tensors.size());
+    parallelFor(0, tensors.size(), [&](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; t++) {
+            if(!contiguous[t].isContiguous()) {
+                contiguous[t].shareDataWith(contiguous[t].copy());
+            }
+            checksums[t] = checkpoint_detail::checksum(
+                reinterpret_cast<const uint8_t*>(contiguous[t].data()),
+                contiguous[t].NElems() * sizeof(TElem));
+        }
+    });
+
+    // The header is built in memory, as the offsets depend on its size
+    size_t header_size = 8 + 4 * sizeof(uint32_t);
+    for(size_t t = 0; t < tensors.size(); t++) {
+        header_size += 2 * sizeof(uint32_t) + names[t].size() +
+                       tensors[t].NDims() * sizeof(uint64_t) + 2 * sizeof(uint64_t);
+    }
+
+    std::vector<uint64_t> offsets(tensors.size());
+    size_t                position = checkpoint_detail::alignedOffset(header_size);
+    for(size_t t = 0; t < tensors.size(); t++) {
+        offsets[t] = position;
+        position += tensors[t].NElems() * sizeof(TElem);
+        position = checkpoint_detail::alignedOffset(position);
+    }
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+        if(!file) {
+            throw std::invalid_argument("Could not open " + temp_path);
+        }
+
+        file.write("SNNLCKPT", 8);
+        writeBinaryValue<uint32_t>(file, CHECKPOINT_VERSION);
+        writeBinaryValue<uint32_t>(file, idxTypeCode<TElem>());
+        writeBinaryValue<uint32_t>(file, CHECKPOINT_ALIGNMENT);
+        writeBinaryValue<uint32_t>(file, tensors.size());
+        for(size_t t = 0; t < tensors.size(); t++) {
+            writeBinaryValue<uint32_t>(file, names[t].size());
+            file.write(names[t].data(), names[t].size());
+            writeBinaryValue<uint32_t>(file, tensors[t].NDims());
+            for(long d = 0; d < tensors[t].NDims(); d++) {
+                writeBinaryValue<uint64_t>(file, tensors[t].shape(d));
+            }
+            writeBinaryValue<uint64_t>(file, offsets[t]);
+            writeBinaryValue<uint64_t>(file, checksums[t]);
+        }
+
+        const std::string padding(CHECKPOINT_ALIGNMENT, '\0');
+        for(size_t t = 0; t < tensors.size(); t++) {
+            file.write(padding.data(), offsets[t] - file.tellp());
+            file.write(reinterpret_cast<const char*>(contiguous[t].data()),
+                       contiguous[t].NElems() * sizeof(TElem));
+        }
+        file.close();
+        if(!file) {
+            throw std::runtime_error("writeCheckpoint: Writing " + temp_path + " failed");
+        }
+    }
+
+    if(std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("writeCheckpoint: Renaming " + temp_path + " to " + path +
+                                 " failed");
+    }
+}
+
+// Copy the tensors of a checkpoint into tensors, which must have the given
+// names and shapes. Everything but the checksums is checked before any data
+// is copied, so after a checksum error the tensors are partly loaded
+template<typename TElem>
+void readCheckpoint(const MappedFile& file, const std::string& path,
+                    const std::vector<std::string>& names, std::vector<Tensor<TElem>>& tensors)
+{
+    CheckpointHeader header = readCheckpointHeader(file, path);
+    if(header.type != idxTypeCode<TElem>()) {
+        throw std::domain_error("readCheckpoint: Element type of " + path +
+                                " does not match the tensors");
+    }
+    if(header.entries.size() != tensors.size() || names.size() != tensors.size()) {
+        throw std::domain_error("readCheckpoint: " + path + " holds " +
+                                std::to_string(header.entries.size()) + " tensors instead of " +
+                                std::to_string(tensors.size()));
+    }
+
+    for(size_t t = 0; t < tensors.size(); t++) {
+        const CheckpointEntry& entry = header.entries[t];
+        if(entry.name != names[t]) {
+            throw std::domain_error("readCheckpoint: Found " + entry.name + " in " + path +
+                                    " instead of " + names[t]);
+        }
+        if(entry.shape != tensors[t].shape()) {
+            throw std::domain_error("readCheckpoint: Tensor " + entry.name + " of shape " +
+                                    entry.shape + " incompatible with target " +
+                                    tensors[t].shape());
+        }
+        if(entry.offset > file.size() ||
+           (file.size() - entry.offset) / sizeof(TElem) < tensors[t].NElems())
+        {
+            throw std::runtime_error("readCheckpoint: Data of " + entry.name +
+                                     " beyond the end of " + path);
+        }
+    }
+
+    if(!header.entries.empty()) {
+        file.advise(header.entries.front().offset, file.size(), MADV_WILLNEED);
+    }
+
+    parallelFor(0, tensors.size(), [&](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; t++) {
+            const CheckpointEntry& entry  = header.entries[t];
+            const uint8_t*         source = file.data() + entry.offset;
+            size_t                 size   = tensors[t].NElems() * sizeof(TElem);
+            if(checkpoint_detail::checksum(source, size) != entry.checksum) {
+                throw std::runtime_error("readCheckpoint: Checksum of " + entry.name + " in " +
+                                         path + " does not match");
+            }
+
+            if(tensors[t].isContiguous()) {
+                std::memcpy(tensors[t].data(), source, size);
+            }
+            else {
+                Tensor<TElem> values(tensors[t].shape());
+                std::memcpy(values.data(), source, size);
+                tensors[t] = values;
+            }
+        }
+    });
+}
+
+} // namespace snnl
@@ -2,4 +2,5 @@
 
 #include "common_connectors.h"
 #include "modules/module_conv2d.h"
-#include "modules/module_dense.h"
\ No newline at end of file
+#include "modules/module_dense.h"
+#include "modules/module_function.h"
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include "forward_declare.h"
+#include "grad_mode.h"
 #include "tensor.h"
+#include "thread_pool.h"
 #include <algorithm>
 #include <cmath>
 #include <cwchar>
@@ -22,6 +24,7 @@ class Connector : public std::enable_shared_from_this<Connector<TElem>>
 {
 
     friend class Node<TElem>;
+    friend class GraphExecutor<TElem>;
 
 protected:
     struct SNodeConnection
@@ -74,7 +77,16 @@ public:
         nconn.input_nodes =
             std::vector<NodeShPtr<TElem>>(prev_nodes_arr.begin(), prev_nodes_arr.end());
 
-        Index            shape  = outputDims(nconn.input_nodes);
+        Index shape = outputDims(nconn.input_nodes);
+
+        if(!gradEnabled()) {
+            // Only the values, without gradient and connection to the inputs
+            NodeShPtr<TElem> output(new Node<TElem>());
+            output->_values.setDims(shape);
+            forwardHandler(nconn.input_nodes, output.get());
+            return output;
+        }
+
         NodeShPtr<TElem> output = Node<TElem>::create(shape);
 
         auto thisPtr      = getPtr();
@@ -151,13 +163,13 @@ protected:
         }
     }
 
-    bool needsGradAbove(Node<TElem>* calling_node)
+    bool needsGradAbove(Node<TElem>* calling_node, bool accumulate)
     {
         auto& nconn           = _node_connections.at(calling_node);
         bool  need_grad_above = false;
 
         for(auto& prev : nconn.input_nodes) {
-            need_grad_above |= prev->needsGradAbove(calling_node);
+            need_grad_above |= prev->needsGradAbove(calling_node, accumulate);
         }
         return need_grad_above;
     }
@@ -72,37 +72,41 @@ class Conv2DConnector : public Connector<TElem>
         long half_width  = kernel_width / 2;
         long half_height = kernel_height / 2;
 
-        for(size_t higherDim = 0; higherDim < input.shape(0); higherDim++) {
-            for(long i = 0; i < image_width; i++) {
-                for(long j = 0; j < image_height; j++) {
+        // Each batch entry writes to its own slice of the output
+        parallelFor(0, input.shape(0), [&](size_t batch_begin, size_t batch_end) {
+            for(size_t higherDim = batch_begin; higherDim < batch_end; higherDim++) {
+                for(long i = 0; i < image_width; i++) {
+                    for(long j = 0; j < image_height; j++) {
 
-                    long i_kernel_begin = std::max(-i, -half_width);
+                        long i_kernel_begin = std::max(-i, -half_width);
 
-                    long i_kernel_end = std::min(image_width - i - 1, half_width);
+                        long i_kernel_end = std::min(image_width - i - 1, half_width);
 
-                    for(long i_kernel = i_kernel_begin; i_kernel <= i_kernel_end; i_kernel++) {
+                        for(long i_kernel = i_kernel_begin; i_kernel <= i_kernel_end; i_kernel++) {
 
-                        long j_kernel_begin = std::max(-j, -half_height);
+                            long j_kernel_begin = std::max(-j, -half_height);
 
-                        long j_kernel_end = std::min(image_height - j - 1, half_height);
+                            long j_kernel_end = std::min(image_height - j - 1, half_height);
 
-                        for(long j_kernel = j_kernel_begin; j_kernel <= j_kernel_end; j_kernel++) {
+                            for(long j_kernel = j_kernel_begin; j_kernel <= j_kernel_end;
+                                j_kernel++) {
 
-                            for(size_t out_chan = 0; out_chan < n_output_channels; out_chan++) {
+                                for(size_t out_chan = 0; out_chan < n_output_channels; out_chan++) {
 
-                                for(size_t in_chan = 0; in_chan < n_input_channels; in_chan++) {
+                                    for(size_t in_chan = 0; in_chan < n_input_channels; in_chan++) {
 
-                                    out_view(higherDim, i, j, out_chan) +=
-                                        kernel(i_kernel + half_width, j_kernel + half_height,
-                                               in_chan, out_chan) *
-                                        input(higherDim, i + i_kernel, j + j_kernel, in_chan);
+                                        out_view(higherDim, i, j, out_chan) +=
+                                            kernel(i_kernel + half_width, j_kernel + half_height,
+                                                   in_chan, out_chan) *
+                                            input(higherDim, i + i_kernel, j + j_kernel, in_chan);
+                                    }
                                 }
                             }
                         }
                     }
                 }
             }
-        }
+        });
     }
 
     void backwardHandler(const Node<TElem>*             output_node,
@@ -127,45 +131,65 @@ class Conv2DConnector : public Connector<TElem>
         long half_width  = kernel_width / 2;
         long half_height = kernel_height / 2;
 
-        for(size_t higherDim = 0; higherDim < input.shape(0); higherDim++) {
+        // The input gradient is split by batch entry. Every chunk sums up its own
+        // contribution to the kernel gradient, which is reduced afterwards
+        auto compute_chunk = [&](size_t batch_begin, size_t batch_end) {
+            Tensor<TElem> chunk_grad_kernel(kernel.shape());
+            chunk_grad_kernel.setAllValues(0);
 
-            for(long i = 0; i < image_width; i++) {
-                for(long j = 0; j < image_height; j++) {
+            for(size_t higherDim = batch_begin; higherDim < batch_end; higherDim++) {
 
-                    long i_kernel_begin = std::max(-i, -half_width);
+                for(long i = 0; i < image_width; i++) {
+                    for(long j = 0; j < image_height; j++) {
 
-                    long i_kernel_end = std::min(image_width - i - 1, half_width);
+                        long i_kernel_begin = std::max(-i, -half_width);
 
-                    for(long i_kernel = i_kernel_begin; i_kernel <= i_kernel_end; i_kernel++) {
+                        long i_kernel_end = std::min(image_width - i - 1, half_width);
 
-                        long j_kernel_begin = std::max(-j, -half_height);
+                        for(long i_kernel = i_kernel_begin; i_kernel <= i_kernel_end; i_kernel++) {
 
-                        long j_kernel_end = std::min(image_height - j - 1, half_height);
+                            long j_kernel_begin = std::max(-j, -half_height);
 
-                        for(long j_kernel = j_kernel_begin; j_kernel <= j_kernel_end; j_kernel++) {
+                            long j_kernel_end = std::min(image_height - j - 1, half_height);
 
-                            for(size_t out_chan = 0; out_chan < n_output_channels; out_chan++) {
+                            for(long j_kernel = j_kernel_begin; j_kernel <= j_kernel_end;
+                                j_kernel++) {
 
-                                for(size_t in_chan = 0; in_chan < n_input_channels; in_chan++) {
+                                for(size_t out_chan = 0; out_chan < n_output_channels; out_chan++) {
 
                                     TElem out_grad = out_grad_view(higherDim, i, j, out_chan);
 
-                                    grad_kernel(i_kernel + half_width, j_kernel + half_height,
-                                                in_chan, out_chan) +=
-                                        input(higherDim, i + i_kernel, j + j_kernel, in_chan) *
-                                        out_grad;
+                                    for(size_t in_chan = 0; in_chan < n_input_channels; in_chan++) {
+
+                                        chunk_grad_kernel(i_kernel + half_width,
+                                                          j_kernel + half_height, in_chan,
+                                                          out_chan) +=
+                                            input(higherDim, i + i_kernel, j + j_kernel, in_chan) *
+                                            out_grad;
 
-                                    grad_input(higherDim, i + i_kernel, j + j_kernel, in_chan) +=
-                                        kernel(i_kernel + half_width, j_kernel + half_height,
-                                               in_chan, out_chan) *
-                                        out_grad;
+                                        grad_input(higherDim, i + i_kernel, j + j_kernel,
+                                                   in_chan) +=
+                                            kernel(i_kernel + half_width, j_kernel + half_height,
+                                                   in_chan, out_chan) *
+                                            out_grad;
+                                    }
                                 }
                             }
                         }
                     }
                 }
             }
-        }
+            return chunk_grad_kernel;
+        };
+
+        Tensor<TElem> zero_grad_kernel(kernel.shape());
+        zero_grad_kernel.setAllValues(0);
+
+        grad_kernel += parallelReduce(0, input.shape(0), zero_grad_kernel, compute_chunk,
+                                      [](Tensor<TElem> a, const Tensor<TElem>& b) {
+                                          a += b;
+                                          return a;
+                                      });
     }
 
 public:
@@ -37,10 +37,16 @@ public:
         auto distributions = input_nodes[0]->values().viewWithNDimsOnTheRight(2);
         auto labels        = input_nodes[1]->values().viewWithNDimsOnTheRight(1);
 
-        for(size_t i = 0; i < labels.shape(-1); i++) {
-            output_node->value() -=
-                log(distributions(i, labels(i)) + std::numeric_limits<TElem>::min());
-        }
+        output_node->value() += parallelReduce(
+            0, labels.shape(-1), static_cast<TElem>(0),
+            [&](size_t row_begin, size_t row_end) {
+                TElem loss = 0;
+                for(size_t i = row_begin; i < row_end; i++) {
+                    loss -= log(distributions(i, labels(i)) + std::numeric_limits<TElem>::min());
+                }
+                return loss;
+            },
+            std::plus<TElem>(), PARALLEL_GRAIN_SIZE);
     }
 
     void backwardHandler(const Node<TElem>*             output_node,
@@ -55,11 +61,17 @@ public:
         // No gradient for labels
         labels_grad.setAllValues(0);
 
-        for(size_t i = 0; i < labels_val.shape(-1); i++) {
-            distributions_grad(i, labels_val(i)) +=
-                -1 / (distributions_val(i, labels_val(i)) + std::numeric_limits<TElem>::min()) *
-                out_grad;
-        }
+        parallelFor(
+            0, labels_val.shape(-1),
+            [&](size_t row_begin, size_t row_end) {
+                for(size_t i = row_begin; i < row_end; i++) {
+                    distributions_grad(i, labels_val(i)) +=
+                        -1 /
+                        (distributions_val(i, labels_val(i)) + std::numeric_limits<TElem>::min()) *
+                        out_grad;
+                }
+            },
+            PARALLEL_GRAIN_SIZE);
     }
 };
 
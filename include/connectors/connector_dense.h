@@ -52,14 +52,16 @@ class DenseConnector : public Connector<TElem>
         auto B_val   = B.values().viewWithNDimsOnTheRight(2);
         auto out_val = output_node->values().viewWithNDimsOnTheRight(2);
 
-        for(size_t higherDim = 0; higherDim < x_val.shape(-2); higherDim++) {
-            for(size_t i = 0; i < out_val.shape(-1); i++) {
-                out_val(higherDim, i) = B_val(i);
-                for(size_t j = 0; j < x.shape(-1); j++) {
-                    out_val(higherDim, i) += W.value(i, j) * x_val(higherDim, j);
+        parallelFor(0, x_val.shape(-2), [&](size_t row_begin, size_t row_end) {
+            for(size_t higherDim = row_begin; higherDim < row_end; higherDim++) {
+                for(size_t i = 0; i < out_val.shape(-1); i++) {
+                    out_val(higherDim, i) = B_val(i);
+                    for(size_t j = 0; j < x.shape(-1); j++) {
+                        out_val(higherDim, i) += W.value(i, j) * x_val(higherDim, j);
+                    }
                 }
             }
-        }
+        });
     }
 
     void backwardHandler(const Node<TElem>*             output,
@@ -76,15 +78,28 @@ class DenseConnector : public Connector<TElem>
         auto B_grad   = B.gradient().viewWithNDimsOnTheRight(2);
         auto out_grad = output->gradient().viewWithNDimsOnTheRight(2);
 
-        for(size_t higherDim = 0; higherDim < x_val.shape(-2); higherDim++) {
-            for(size_t i = 0; i < out_grad.shape(-1); i++) {
-                B_grad(i) += output->grad(higherDim, i);
-                for(size_t j = 0; j < x_val.shape(-1); j++) {
-                    x_grad(higherDim, j) += W.value(i, j) * output->grad(higherDim, i);
-                    W.grad(i, j) += x_val(higherDim, j) * output->grad(higherDim, i);
+        // Two passes with disjoint writes: The input gradient is split by rows of x,
+        // the weight and bias gradients by output units
+        parallelFor(0, x_val.shape(-2), [&](size_t row_begin, size_t row_end) {
+            for(size_t higherDim = row_begin; higherDim < row_end; higherDim++) {
+                for(size_t i = 0; i < out_grad.shape(-1); i++) {
+                    for(size_t j = 0; j < x_val.shape(-1); j++) {
+                        x_grad(higherDim, j) += W.value(i, j) * out_grad(higherDim, i);
+                    }
                 }
             }
-        }
+        });
+
+        parallelFor(0, out_grad.shape(-1), [&](size_t unit_begin, size_t unit_end) {
+            for(size_t higherDim = 0; higherDim < x_val.shape(-2); higherDim++) {
+                for(size_t i = unit_begin; i < unit_end; i++) {
+                    B_grad(i) += out_grad(higherDim, i);
+                    for(size_t j = 0; j < x_val.shape(-1); j++) {
+                        W.grad(i, j) += x_val(higherDim, j) * out_grad(higherDim, i);
+                    }
+                }
+            }
+        });
     }
 
 public:
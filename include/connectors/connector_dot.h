@@ -133,15 +133,19 @@ class DotConnector : public Connector<TElem>
 
         auto out_view = output.viewAs(out_view_shape);
 
-        for(size_t i = 0; i < a_view.shape(0); i++) {
-            for(size_t j = 0; j < b_view.shape(0); j++) {
+        // Split by rows (i, j) of the output
+        size_t n_b_rows = b_view.shape(0);
+        parallelFor(0, a_view.shape(0) * n_b_rows, [&](size_t row_begin, size_t row_end) {
+            for(size_t row = row_begin; row < row_end; row++) {
+                size_t i = row / n_b_rows;
+                size_t j = row % n_b_rows;
                 for(size_t k = 0; k < a_view.shape(-1); k++) {
                     for(size_t l = 0; l < b_view.shape(-1); l++) {
                         out_view(i, j, l) += a_view(i, k) * b_view(j, k, l);
                     }
                 }
             }
-        }
+        });
     }
 
     void backwardHandler(const Node<TElem>*             output_node,
@@ -210,16 +214,31 @@ class DotConnector : public Connector<TElem>
 
         auto out_grad_view = output_grad.viewAs(out_view_shape);
 
-        for(size_t i = 0; i < a_view.shape(0); i++) {
-            for(size_t j = 0; j < b_view.shape(0); j++) {
-                for(size_t k = 0; k < a_view.shape(-1); k++) {
-                    for(size_t l = 0; l < b_view.shape(-1); l++) {
-                        a_grad_view(i, k) += b_view(j, k, l) * out_grad_view(i, j, l);
-                        b_grad_view(j, k, l) += a_view(i, k) * out_grad_view(i, j, l);
+        // Two passes with disjoint writes: The gradient of a is split by its rows
+        // i, the gradient of b by the contracted axis k
+        parallelFor(0, a_view.shape(0), [&](size_t row_begin, size_t row_end) {
+            for(size_t i = row_begin; i < row_end; i++) {
+                for(size_t j = 0; j < b_view.shape(0); j++) {
+                    for(size_t k = 0; k < a_view.shape(-1); k++) {
+                        for(size_t l = 0; l < b_view.shape(-1); l++) {
+                            a_grad_view(i, k) += b_view(j, k, l) * out_grad_view(i, j, l);
+                        }
                     }
                 }
             }
-        }
+        });
+
+        parallelFor(0, a_view.shape(-1), [&](size_t k_begin, size_t k_end) {
+            for(size_t i = 0; i < a_view.shape(0); i++) {
+                for(size_t j = 0; j < b_view.shape(0); j++) {
+                    for(size_t k = k_begin; k < k_end; k++) {
+                        for(size_t l = 0; l < b_view.shape(-1); l++) {
+                            b_grad_view(j, k, l) += a_view(i, k) * out_grad_view(i, j, l);
+                        }
+                    }
+                }
+            }
+        });
     }
 
 public:
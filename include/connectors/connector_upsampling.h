@@ -45,24 +45,26 @@ class UpSampleConnector : public Connector<TElem>
         TElem weight = static_cast<TElem>(static_cast<TElem>(1.0) /
                                           static_cast<TElem>(_pool_height * _pool_width));
 
-        for(size_t higherDim = 0; higherDim < input.shape(0); higherDim++) {
-            for(size_t i = 0; i < image_width; i++) {
-                for(size_t j = 0; j < image_height; j++) {
+        parallelFor(0, input.shape(0), [&](size_t batch_begin, size_t batch_end) {
+            for(size_t higherDim = batch_begin; higherDim < batch_end; higherDim++) {
+                for(size_t i = 0; i < image_width; i++) {
+                    for(size_t j = 0; j < image_height; j++) {
 
-                    for(size_t i_pool = 0; i_pool < _pool_width; i_pool++) {
+                        for(size_t i_pool = 0; i_pool < _pool_width; i_pool++) {
 
-                        for(size_t j_pool = 0; j_pool < _pool_height; j_pool++) {
+                            for(size_t j_pool = 0; j_pool < _pool_height; j_pool++) {
 
-                            for(size_t out_chan = 0; out_chan < n_channels; out_chan++) {
-                                out_view(higherDim, i * _pool_width + i_pool,
-                                         j * _pool_height + j_pool, out_chan) +=
-                                    weight * input(higherDim, i, j, out_chan);
+                                for(size_t out_chan = 0; out_chan < n_channels; out_chan++) {
+                                    out_view(higherDim, i * _pool_width + i_pool,
+                                             j * _pool_height + j_pool, out_chan) +=
+                                        weight * input(higherDim, i, j, out_chan);
+                                }
                             }
                         }
                     }
                 }
             }
-        }
+        });
     }
 
     void backwardHandler(const Node<TElem>*             output_node,
@@ -81,24 +83,26 @@ class UpSampleConnector : public Connector<TElem>
         TElem weight = static_cast<TElem>(static_cast<TElem>(1.0) /
                                           static_cast<TElem>(_pool_height * _pool_width));
 
-        for(size_t higherDim = 0; higherDim < input_grad.shape(0); higherDim++) {
-            for(size_t i = 0; i < image_width; i++) {
-                for(size_t j = 0; j < image_height; j++) {
+        parallelFor(0, input_grad.shape(0), [&](size_t batch_begin, size_t batch_end) {
+            for(size_t higherDim = batch_begin; higherDim < batch_end; higherDim++) {
+                for(size_t i = 0; i < image_width; i++) {
+                    for(size_t j = 0; j < image_height; j++) {
 
-                    for(size_t i_pool = 0; i_pool < _pool_width; i_pool++) {
+                        for(size_t i_pool = 0; i_pool < _pool_width; i_pool++) {
 
-                        for(size_t j_pool = 0; j_pool < _pool_height; j_pool++) {
+                            for(size_t j_pool = 0; j_pool < _pool_height; j_pool++) {
 
-                            for(size_t out_chan = 0; out_chan < n_channels; out_chan++) {
-                                input_grad(higherDim, i, j, out_chan) +=
-                                    weight * out_grad_view(higherDim, i * _pool_width + i_pool,
-                                                           j * _pool_height + j_pool, out_chan);
+                                for(size_t out_chan = 0; out_chan < n_channels; out_chan++) {
+                                    input_grad(higherDim, i, j, out_chan) +=
+                                        weight * out_grad_view(higherDim, i * _pool_width + i_pool,
+                                                               j * _pool_height + j_pool, out_chan);
+                                }
                             }
                         }
                     }
                 }
             }
-        }
+        });
     }
 
     UpSampleConnector(size_t pool_width, size_t pool_height)
@@ -24,9 +24,14 @@ public:
         auto input_vals  = input_nodes.front()->values().flatten();
         auto output_vals = output_node->values().flatten();
 
-        for(size_t ind = 0; ind < output_vals.size(); ind++) {
-            output_vals(ind) = Functor<TElem>::forward(input_vals(ind));
-        }
+        parallelFor(
+            0, output_vals.size(),
+            [&](size_t begin, size_t end) {
+                for(size_t ind = begin; ind < end; ind++) {
+                    output_vals(ind) = Functor<TElem>::forward(input_vals(ind));
+                }
+            },
+            PARALLEL_GRAIN_SIZE);
     }
 
     void backwardHandler(const Node<TElem>*             output_node,
@@ -36,12 +41,17 @@ public:
         auto input_grad  = input_nodes.front()->gradient().flatten();
         auto output_grad = output_node->gradient().flatten();
 
-        for(size_t ind = 0; ind < output_grad.size(); ind++) {
-            TElem input_value     = input_vals(ind);
-            TElem output_gradient = output_grad(ind);
-
-            input_grad(ind) += Functor<TElem>::backward(input_value) * output_gradient;
-        }
+        parallelFor(
+            0, output_grad.size(),
+            [&](size_t begin, size_t end) {
+                for(size_t ind = begin; ind < end; ind++) {
+                    TElem input_value     = input_vals(ind);
+                    TElem output_gradient = output_grad(ind);
+
+                    input_grad(ind) += Functor<TElem>::backward(input_value) * output_gradient;
+                }
+            },
+            PARALLEL_GRAIN_SIZE);
     }
 };
 } // namespace snnl
\ No newline at end of file
@@ -0,0 +1,235 @@
+#pragma once
+#include "forward_declare.h"
+#include "module.h"
+#include "node.h"
+#include "optimizer.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace snnl
+{
+
+// How the loss function reduces over the samples of a batch. Determines how the
+// gradients of the shards are combined
+enum class LossReduction
+{
+    Mean,
+    Sum
+};
+
+/*
+Synchronous data parallel training on the thread pool. The model is replicated
+num_replicas - 1 times via make_replica. Every trainStep splits the batch along
+the first axis into one shard per replica, runs forward and backward of all
+replicas concurrently and reduces their gradients into the model. The optimizer
+then updates the model once and the new weights are copied to the replicas.
+
+Weights are matched by their insertion order, so make_replica has to build the
+same architecture as the model. e.g.
+
+MNistModel           model(28, 28);
+AdamOptimizer<float> optimizer;
+
+DataParallelTrainer<float> trainer(
+    model,
+    [] {
+        return std::make_shared<MNistModel>(28, 28);
+    },
+    4,
+    [](Module<float>& replica, std::vector<NodeShPtr<float>> batch) {
+        return SparseCategoricalCrosseEntropy(replica.call(batch[0]), batch[1]);
+    },
+    LossReduction::Sum);
+
+auto [images, labels] = train_generator.generateBatch(128);
+float loss = trainer.trainStep({images, labels}, optimizer);
+*/
+template<class TElem>
+class DataParallelTrainer
+{
+public:
+    using LossFunction =
+        std::function<NodeShPtr<TElem>(Module<TElem>&, std::vector<NodeShPtr<TElem>>)>;
+
+private:
+    // Part of a single weight. The reduction works chunk by chunk, so that the
+    // accumulated chunk stays in cache while the replicas are added to it
+    struct Chunk
+    {
+        size_t weight;
+        size_t begin;
+        size_t end;
+    };
+
+    Module<TElem>&                  _model;
+    std::vector<ModuleShPtr<TElem>> _replicas;
+    LossFunction                    _loss_function;
+    LossReduction                   _reduction;
+
+    // Weights of the model followed by those of the replicas, matched by index
+    std::vector<std::vector<NodeShPtr<TElem>>> _weights;
+    std::vector<Chunk>                         _chunks;
+
+    Module<TElem>& replica(size_t index) { return index == 0 ? _model : *_replicas[index - 1]; }
+
+    // Scaled sum of the gradients of the first num_shards replicas, written to
+    // the model
+    void reduceGradients(const std::vector<TElem>& scales)
+    {
+        parallelFor(0, _chunks.size(), [&](size_t chunk_begin, size_t chunk_end) {
+            for(size_t c = chunk_begin; c < chunk_end; c++) {
+                const Chunk& chunk = _chunks[c];
+                TElem*       sum   = _weights[0][chunk.weight]->gradient().data();
+
+                for(size_t i = chunk.begin; i < chunk.end; i++) {
+                    sum[i] *= scales[0];
+                }
+                for(size_t r = 1; r < scales.size(); r++) {
+                    const TElem* grad  = _weights[r][chunk.weight]->gradient().data();
+                    TElem        scale = scales[r];
+                    for(size_t i = chunk.begin; i < chunk.end; i++) {
+                        sum[i] += scale * grad[i];
+                    }
+                }
+            }
+        });
+    }
+
+public:
+    DataParallelTrainer(Module<TElem>& model, std::function<ModuleShPtr<TElem>()> make_replica,
+                        size_t num_replicas, LossFunction loss_function,
+                        LossReduction reduction = LossReduction::Mean)
+        : _model(model)
+        , _loss_function(loss_function)
+        , _reduction(reduction)
+    {
+        if(num_replicas == 0) {
+            throw std::invalid_argument("DataParallelTrainer: Need at least one replica");
+        }
+
+        for(size_t i = 1; i < num_replicas; i++) {
+            _replicas.push_back(make_replica());
+        }
+
+        for(size_t r = 0; r < num_replicas; r++) {
+            _weights.push_back(replica(r).weightsSortedByInsertion());
+
+            if(_weights[r].size() != _weights[0].size()) {
+                throw std::invalid_argument(
+                    "DataParallelTrainer: Replicas differ in their number of weights");
+            }
+            for(size_t w = 0; w < _weights[r].size(); w++) {
+                if(_weights[r][w]->shape() != _weights[0][w]->shape()) {
+                    throw std::invalid_argument(
+                        "DataParallelTrainer: Weight shapes of the replicas differ: " +
+                        _weights[r][w]->shape() + " vs. " + _weights[0][w]->shape());
+                }
+            }
+        }
+
+        for(size_t w = 0; w < _weights[0].size(); w++) {
+            size_t size = _weights[0][w]->NElems();
+            for(size_t begin = 0; begin < size; begin += PARALLEL_GRAIN_SIZE) {
+                _chunks.push_back({w, begin, std::min(begin + PARALLEL_GRAIN_SIZE, size)});
+            }
+        }
+
+        broadcastWeights();
+    }
+
+    DataParallelTrainer(const DataParallelTrainer&) = delete;
+
+    size_t numReplicas() const { return _replicas.size() + 1; }
+
+    Module<TElem>& model() { return _model; }
+
+    // Copy the weights of the model to all replicas. Needs to be called if the
+    // weights of the model are changed outside of trainStep
+    void broadcastWeights()
+    {
+        parallelFor(0, _chunks.size(), [&](size_t chunk_begin, size_t chunk_end) {
+            for(size_t c = chunk_begin; c < chunk_end; c++) {
+                const Chunk& chunk  = _chunks[c];
+                const TElem* source = _weights[0][chunk.weight]->values().data();
+                for(size_t r = 1; r < _weights.size(); r++) {
+                    TElem* target = _weights[r][chunk.weight]->values().data();
+                    std::copy(source + chunk.begin, source + chunk.end, target + chunk.begin);
+                }
+            }
+        });
+    }
+
+    // Run one training step on the given batch and return its loss
+    TElem trainStep(const std::vector<NodeShPtr<TElem>>& batch, Optimizer<TElem>& optimizer)
+    {
+        if(batch.empty()) {
+            throw std::invalid_argument("DataParallelTrainer: Empty batch");
+        }
+        size_t batch_size = batch[0]->shape(0);
+        for(auto& node : batch) {
+            if(node->shape(0) != batch_size) {
+                throw std::invalid_argument("DataParallelTrainer: Batch sizes of inputs differ");
+            }
+        }
+        if(batch_size == 0) {
+            throw std::invalid_argument("DataParallelTrainer: Empty batch");
+        }
+
+        size_t num_shards = std::min(numReplicas(), batch_size);
+
+        std::vector<NodeShPtr<TElem>> losses(num_shards);
+        std::vector<TElem>            scales(num_shards);
+
+        // One replica per chunk. The loops of the connectors thus run inline
+        parallelFor(0, num_shards, [&](size_t shard_begin, size_t shard_end) {
+            for(size_t shard = shard_begin; shard < shard_end; shard++) {
+                size_t row_begin = batch_size * shard / num_shards;
+                size_t row_end   = batch_size * (shard + 1) / num_shards;
+
+                std::vector<NodeShPtr<TElem>> inputs;
+                for(auto& node : batch) {
+                    Index shape = node->shape();
+                    shape[0]    = row_end - row_begin;
+
+                    auto input      = Node<TElem>::create(shape);
+                    input->values() = node->values().viewAs(range(row_begin, row_end), ellipsis());
+                    inputs.push_back(input);
+                }
+
+                losses[shard] = _loss_function(replica(shard), inputs);
+                losses[shard]->computeGrad();
+
+                scales[shard] = _reduction == LossReduction::Mean
+                                    ? static_cast<TElem>(row_end - row_begin) / batch_size
+                                    : TElem(1);
+            }
+        });
+
+        reduceGradients(scales);
+
+        // The graph of the first shard leads to the weights of the model
+        optimizer.optimizeStep(losses[0]);
+
+        broadcastWeights();
+
+        TElem loss = 0;
+        for(size_t shard = 0; shard < num_shards; shard++) {
+            loss += scales[shard] * losses[shard]->value();
+        }
+        return loss;
+    }
+
+    template<size_t NumTensors>
+    TElem trainStep(const std::array<NodeShPtr<TElem>, NumTensors>& batch,
+                    Optimizer<TElem>& optimizer)
+    {
+        return trainStep(std::vector<NodeShPtr<TElem>>(batch.begin(), batch.end()), optimizer);
+    }
+};
+
+} // namespace snnl
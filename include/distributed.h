@@ -0,0 +1,770 @@
+#pragma once
+#include "forward_declare.h"
+#include "module.h"
+#include "node.h"
+#include "optimizer.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <new>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Collective operations between the processes of a distributed training run. All
+processes have to call them in the same order with the same sizes.
+
+The ranks form a ring: Each process only exchanges data with its left and right
+neighbor. allreduce splits the data into one chunk per process. During the
+first size - 1 steps (reduce scatter) every process adds the chunk received from
+the left to its own and passes it on, until each process owns one fully reduced
+chunk. During the next size - 1 steps (all gather) these chunks are passed
+around the ring once more. Every process thus sends and receives
+2 * (size - 1) / size times the data, independent of the number of processes.
+*/
+template<class TElem>
+class Communicator
+{
+protected:
+    size_t _rank;
+    size_t _size;
+
+    Communicator(size_t rank, size_t size)
+        : _rank(rank)
+        , _size(size)
+    {
+        if(size == 0 || rank >= size) {
+            throw std::invalid_argument("Communicator: Invalid rank " + std::to_string(rank) +
+                                        " for " + std::to_string(size) + " processes");
+        }
+    }
+
+    size_t leftNeighbor() const { return (_rank + _size - 1) % _size; }
+
+    size_t rightNeighbor() const { return (_rank + 1) % _size; }
+
+    size_t chunkBegin(size_t chunk, size_t num_elems) const
+    {
+        return num_elems * (chunk % _size) / _size;
+    }
+
+    size_t chunkEnd(size_t chunk, size_t num_elems) const
+    {
+        return num_elems * (chunk % _size + 1) / _size;
+    }
+
+public:
+    Communicator(const Communicator&) = delete;
+
+    virtual ~Communicator() {}
+
+    size_t rank() const { return _rank; }
+
+    size_t size() const { return _size; }
+
+    // Sum data over all processes in place
+    virtual void allreduce(TElem* data, size_t num_elems) = 0;
+
+    // Copy bytes of process root to all other processes
+    virtual void broadcast(std::vector<uint8_t>& bytes, size_t root) = 0;
+
+    virtual void barrier() = 0;
+};
+
+// POSIX shared memory, which stays mapped in all processes forked after its
+// creation
+class SharedMemoryRegion
+{
+    uint8_t* _data = nullptr;
+    size_t   _size = 0;
+
+public:
+    explicit SharedMemoryRegion(size_t size)
+        : _size(size)
+    {
+        static std::atomic<size_t> counter = 0;
+
+        std::string name = "/snnl-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0) {
+            throw std::runtime_error("shm_open failed: " + std::string(std::strerror(errno)));
+        }
+        // The mapping keeps the memory alive, the name is not needed anymore
+        shm_unlink(name.c_str());
+
+        if(ftruncate(fd, size) != 0) {
+            close(fd);
+            throw std::runtime_error("ftruncate failed: " + std::string(std::strerror(errno)));
+        }
+
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(ptr == MAP_FAILED) {
+            throw std::runtime_error("mmap failed: " + std::string(std::strerror(errno)));
+        }
+        _data = static_cast<uint8_t*>(ptr);
+    }
+
+    SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+
+    ~SharedMemoryRegion() { munmap(_data, _size); }
+
+    uint8_t* data() { return _data; }
+
+    size_t size() const { return _size; }
+};
+
+/*
+Communicator for processes on one machine. Every process owns a slot for
+capacity elements in a shared memory region. Instead of sending a chunk to its
+right neighbor, a process reads it directly from the slot of its left
+neighbor. The processes only synchronize through one step counter each: Before
+step s, a process waits until both neighbors have finished s steps. The left
+one has then written the chunk to be read and the right one has read the chunk
+to be overwritten.
+*/
+template<class TElem>
+class SharedMemoryCommunicator : public Communicator<TElem>
+{
+    struct alignas(64) Counter
+    {
+        std::atomic<uint64_t> value;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "Shared memory communication needs lock free atomics");
+
+    std::shared_ptr<SharedMemoryRegion> _region;
+    size_t                              _capacity;
+    size_t                              _broadcast_capacity;
+
+    // Barrier counters followed by one step counter per process
+    Counter*  _counters;
+    TElem*    _slots;
+    uint64_t* _broadcast_size;
+    uint8_t*  _broadcast_data;
+
+    // Steps finished by this process
+    uint64_t _steps = 0;
+
+    static size_t alignedSize(size_t bytes) { return (bytes + 63) / 64 * 64; }
+
+    static size_t countersSize(size_t size) { return (size + 2) * sizeof(Counter); }
+
+    static size_t slotsSize(size_t size, size_t capacity)
+    {
+        return alignedSize(size * capacity * sizeof(TElem));
+    }
+
+    Counter& arrived() { return _counters[0]; }
+
+    Counter& generation() { return _counters[1]; }
+
+    Counter& steps(size_t rank) { return _counters[2 + rank]; }
+
+    TElem* slot(size_t rank) { return _slots + rank * _capacity; }
+
+    template<typename Predicate>
+    static void spinUntil(Predicate&& done)
+    {
+        while(!done()) {
+            std::this_thread::yield();
+        }
+    }
+
+    void finishStep() { steps(this->_rank).value.store(++_steps, std::memory_order_release); }
+
+public:
+    // Allocate the region shared by all processes. Has to be called before
+    // forking
+    static std::shared_ptr<SharedMemoryRegion> createRegion(size_t size, size_t capacity,
+                                                            size_t broadcast_capacity)
+    {
+        auto region = std::make_shared<SharedMemoryRegion>(
+            countersSize(size) + slotsSize(size, capacity) + sizeof(uint64_t) +
+            broadcast_capacity);
+
+        auto* counters = reinterpret_cast<Counter*>(region->data());
+        for(size_t i = 0; i < size + 2; i++) {
+            new(&counters[i].value) std::atomic<uint64_t>(0);
+        }
+        return region;
+    }
+
+    SharedMemoryCommunicator(std::shared_ptr<SharedMemoryRegion> region, size_t rank, size_t size,
+                             size_t capacity, size_t broadcast_capacity)
+        : Communicator<TElem>(rank, size)
+        , _region(region)
+        , _capacity(capacity)
+        , _broadcast_capacity(broadcast_capacity)
+    {
+        uint8_t* data = _region->data();
+
+        _counters = reinterpret_cast<Counter*>(data);
+        data += countersSize(size);
+        _slots = reinterpret_cast<TElem*>(data);
+        data += slotsSize(size, capacity);
+        _broadcast_size = reinterpret_cast<uint64_t*>(data);
+        _broadcast_data = data + sizeof(uint64_t);
+    }
+
+    void allreduce(TElem* data, size_t num_elems) override
+    {
+        if(num_elems > _capacity) {
+            throw std::invalid_argument("SharedMemoryCommunicator: " + std::to_string(num_elems) +
+                                        " elements exceed the capacity of " +
+                                        std::to_string(_capacity));
+        }
+        size_t size = this->_size;
+        size_t rank = this->_rank;
+        if(size == 1) {
+            return;
+        }
+
+        size_t       left      = this->leftNeighbor();
+        size_t       right     = this->rightNeighbor();
+        TElem*       own       = slot(rank);
+        const TElem* from_left = slot(left);
+
+        // Step 0 copies the data into the own slot, followed by size - 1 steps
+        // of reduce scatter and size - 1 steps of all gather
+        for(size_t step = 0; step < 2 * size - 1; step++) {
+            spinUntil([&] {
+                return steps(left).value.load(std::memory_order_acquire) >= _steps &&
+                       steps(right).value.load(std::memory_order_acquire) >= _steps;
+            });
+
+            if(step == 0) {
+                std::copy(data, data + num_elems, own);
+            }
+            else if(step < size) {
+                size_t chunk = rank + size - step;
+                size_t end   = this->chunkEnd(chunk, num_elems);
+                for(size_t i = this->chunkBegin(chunk, num_elems); i < end; i++) {
+                    own[i] += from_left[i];
+                }
+            }
+            else {
+                size_t chunk = rank + 2 * size - step;
+                size_t begin = this->chunkBegin(chunk, num_elems);
+                size_t end   = this->chunkEnd(chunk, num_elems);
+                std::copy(from_left + begin, from_left + end, own + begin);
+            }
+            finishStep();
+        }
+
+        std::copy(own, own + num_elems, data);
+    }
+
+    void broadcast(std::vector<uint8_t>& bytes, size_t root) override
+    {
+        // Wait for the readers of a previous broadcast
+        barrier();
+        if(this->_rank == root) {
+            if(bytes.size() > _broadcast_capacity) {
+                throw std::invalid_argument("SharedMemoryCommunicator: Broadcast of " +
+                                            std::to_string(bytes.size()) +
+                                            " bytes exceeds the capacity of " +
+                                            std::to_string(_broadcast_capacity));
+            }
+            *_broadcast_size = bytes.size();
+            std::copy(bytes.begin(), bytes.end(), _broadcast_data);
+        }
+        barrier();
+        if(this->_rank != root) {
+            bytes.assign(_broadcast_data, _broadcast_data + *_broadcast_size);
+        }
+    }
+
+    void barrier() override
+    {
+        uint64_t current = generation().value.load(std::memory_order_acquire);
+        if(arrived().value.fetch_add(1, std::memory_order_acq_rel) + 1 == this->_size) {
+            arrived().value.store(0, std::memory_order_relaxed);
+            generation().value.store(current + 1, std::memory_order_release);
+        }
+        else {
+            spinUntil([&] {
+                return generation().value.load(std::memory_order_acquire) != current;
+            });
+        }
+    }
+};
+
+/*
+Communicator over TCP, which also works across machines. Process i listens on
+base_port + i of hosts[i] (IPv4 addresses), connects to its right neighbor and
+accepts the connection of its left one.
+*/
+template<class TElem>
+class TcpCommunicator : public Communicator<TElem>
+{
+    // Connections to the right and from the left neighbor
+    int _send_fd = -1;
+    int _recv_fd = -1;
+
+    std::vector<TElem> _recv_buffer;
+
+    [[noreturn]] static void throwErrno(const std::string& what)
+    {
+        throw std::runtime_error("TcpCommunicator: " + what + " failed: " + std::strerror(errno));
+    }
+
+    // Send and receive at the same time. Blocking on either of them could dead
+    // lock the ring as soon as the socket buffers are full
+    void exchange(const void* send_data, size_t send_bytes, void* recv_data, size_t recv_bytes)
+    {
+        auto* send_ptr = static_cast<const uint8_t*>(send_data);
+        auto* recv_ptr = static_cast<uint8_t*>(recv_data);
+
+        while(send_bytes > 0 || recv_bytes > 0) {
+            // Negative file descriptors are ignored by poll
+            pollfd fds[2] = {{send_bytes > 0 ? _send_fd : -1, POLLOUT, 0},
+                             {recv_bytes > 0 ? _recv_fd : -1, POLLIN, 0}};
+
+            if(poll(fds, 2, -1) < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throwErrno("poll");
+            }
+
+            if(fds[0].revents) {
+                ssize_t sent = send(_send_fd, send_ptr, send_bytes, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    throwErrno("send");
+                }
+                if(sent > 0) {
+                    send_ptr += sent;
+                    send_bytes -= sent;
+                }
+            }
+            if(fds[1].revents) {
+                ssize_t received = recv(_recv_fd, recv_ptr, recv_bytes, MSG_DONTWAIT);
+                if(received == 0) {
+                    throw std::runtime_error("TcpCommunicator: Connection closed by peer");
+                }
+                if(received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    throwErrno("recv");
+                }
+                if(received > 0) {
+                    recv_ptr += received;
+                    recv_bytes -= received;
+                }
+            }
+        }
+    }
+
+    void sendToRight(const void* data, size_t bytes) { exchange(data, bytes, nullptr, 0); }
+
+    void receiveFromLeft(void* data, size_t bytes) { exchange(nullptr, 0, data, bytes); }
+
+    static sockaddr_in address(const std::string& host, uint16_t port)
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(port);
+        if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            throw std::invalid_argument("TcpCommunicator: Invalid IPv4 address " + host);
+        }
+        return addr;
+    }
+
+    void closeSockets()
+    {
+        for(int fd : {_send_fd, _recv_fd}) {
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+        _send_fd = _recv_fd = -1;
+    }
+
+public:
+    TcpCommunicator(size_t rank, size_t size, const std::vector<std::string>& hosts,
+                    uint16_t base_port, std::chrono::seconds timeout = std::chrono::seconds(30))
+        : Communicator<TElem>(rank, size)
+    {
+        if(hosts.size() != size) {
+            throw std::invalid_argument("TcpCommunicator: Need one host per process");
+        }
+        if(size == 1) {
+            return;
+        }
+
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(listen_fd < 0) {
+            throwErrno("socket");
+        }
+        int enable = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        sockaddr_in listen_addr     = address(hosts[rank], base_port + rank);
+        listen_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if(bind(listen_fd, reinterpret_cast<sockaddr*>(&listen_addr), sizeof(listen_addr)) != 0 ||
+           listen(listen_fd, 1) != 0)
+        {
+            close(listen_fd);
+            throwErrno("bind");
+        }
+
+        // The right neighbor might not listen yet
+        size_t      right      = this->rightNeighbor();
+        sockaddr_in right_addr = address(hosts[right], base_port + right);
+        auto        deadline   = std::chrono::steady_clock::now() + timeout;
+        while(true) {
+            _send_fd = socket(AF_INET, SOCK_STREAM, 0);
+            if(_send_fd < 0) {
+                close(listen_fd);
+                throwErrno("socket");
+            }
+            if(connect(_send_fd, reinterpret_cast<sockaddr*>(&right_addr), sizeof(right_addr)) ==
+               0)
+            {
+                break;
+            }
+            close(_send_fd);
+            _send_fd = -1;
+            if(std::chrono::steady_clock::now() > deadline) {
+                close(listen_fd);
+                throwErrno("connect");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        _recv_fd = accept(listen_fd, nullptr, nullptr);
+        close(listen_fd);
+        if(_recv_fd < 0) {
+            closeSockets();
+            throwErrno("accept");
+        }
+
+        for(int fd : {_send_fd, _recv_fd}) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+    }
+
+    ~TcpCommunicator() { closeSockets(); }
+
+    void allreduce(TElem* data, size_t num_elems) override
+    {
+        size_t size = this->_size;
+        size_t rank = this->_rank;
+        if(size == 1) {
+            return;
+        }
+
+        _recv_buffer.resize(num_elems / size + 1);
+
+        // Reduce scatter: Pass on the chunk updated last, add the received one
+        for(size_t step = 1; step < size; step++) {
+            size_t send_chunk  = rank + size - step + 1;
+            size_t recv_chunk  = rank + size - step;
+            size_t send_begin  = this->chunkBegin(send_chunk, num_elems);
+            size_t send_length = this->chunkEnd(send_chunk, num_elems) - send_begin;
+            size_t recv_begin  = this->chunkBegin(recv_chunk, num_elems);
+            size_t recv_length = this->chunkEnd(recv_chunk, num_elems) - recv_begin;
+
+            exchange(data + send_begin, send_length * sizeof(TElem), _recv_buffer.data(),
+                     recv_length * sizeof(TElem));
+
+            for(size_t i = 0; i < recv_length; i++) {
+                data[recv_begin + i] += _recv_buffer[i];
+            }
+        }
+
+        // All gather: Pass on the reduced chunks
+        for(size_t step = 0; step + 1 < size; step++) {
+            size_t send_chunk  = rank + size - step + 1;
+            size_t recv_chunk  = rank + size - step;
+            size_t send_begin  = this->chunkBegin(send_chunk, num_elems);
+            size_t send_length = this->chunkEnd(send_chunk, num_elems) - send_begin;
+            size_t recv_begin  = this->chunkBegin(recv_chunk, num_elems);
+            size_t recv_length = this->chunkEnd(recv_chunk, num_elems) - recv_begin;
+
+            exchange(data + send_begin, send_length * sizeof(TElem), data + recv_begin,
+                     recv_length * sizeof(TElem));
+        }
+    }
+
+    void broadcast(std::vector<uint8_t>& bytes, size_t root) override
+    {
+        if(this->_size == 1) {
+            return;
+        }
+        uint64_t num_bytes = bytes.size();
+        if(this->_rank != root) {
+            receiveFromLeft(&num_bytes, sizeof(num_bytes));
+            bytes.resize(num_bytes);
+            receiveFromLeft(bytes.data(), num_bytes);
+        }
+        if(this->rightNeighbor() != root) {
+            sendToRight(&num_bytes, sizeof(num_bytes));
+            sendToRight(bytes.data(), num_bytes);
+        }
+    }
+
+    // A token travels around the ring twice. After the first round, rank 0
+    // knows that all processes have arrived, the second round tells the others
+    void barrier() override
+    {
+        if(this->_size == 1) {
+            return;
+        }
+        uint8_t token = 0;
+        for(size_t round = 0; round < 2; round++) {
+            if(this->_rank == 0) {
+                sendToRight(&token, 1);
+                receiveFromLeft(&token, 1);
+            }
+            else {
+                receiveFromLeft(&token, 1);
+                sendToRight(&token, 1);
+            }
+        }
+    }
+};
+
+/*
+Data parallel training with one process per model replica. Every process runs
+its own training loop on its own data and calls trainStep with its loss. The
+gradients are averaged over all processes before each update, so the weights
+stay identical everywhere. On construction, the weights of rank 0 are sent to
+all other processes using the layout of Module::toByteArray.
+*/
+template<class TElem>
+class DistributedTrainer
+{
+    Module<TElem>&       _model;
+    Communicator<TElem>& _communicator;
+
+    // Gradients of all weights in insertion order, followed by the loss
+    std::vector<TElem> _buffer;
+
+public:
+    DistributedTrainer(Module<TElem>& model, Communicator<TElem>& communicator)
+        : _model(model)
+        , _communicator(communicator)
+    {
+        size_t num_elems = 1;
+        for(auto& weight : _model.weightsSortedByInsertion()) {
+            num_elems += weight->NElems();
+        }
+        _buffer.resize(num_elems);
+
+        broadcastWeights();
+    }
+
+    DistributedTrainer(const DistributedTrainer&) = delete;
+
+    Communicator<TElem>& communicator() { return _communicator; }
+
+    // Copy the weights of rank 0 to all other processes
+    void broadcastWeights()
+    {
+        std::vector<uint8_t> bytes;
+        if(_communicator.rank() == 0) {
+            bytes = _model.toByteArray();
+        }
+        _communicator.broadcast(bytes, 0);
+        if(_communicator.rank() != 0) {
+            _model.fromByteArray(bytes);
+        }
+        _communicator.barrier();
+    }
+
+    // Compute the gradients of loss, average them over all processes and
+    // update the weights. Returns the loss averaged over all processes
+    TElem trainStep(NodeShPtr<TElem> loss, Optimizer<TElem>& optimizer)
+    {
+        loss->computeGrad();
+
+        // A packed model has all gradients in one buffer, which is copied at once
+        TElem* buffer = _buffer.data();
+        if(_model.isPacked()) {
+            Tensor<TElem>& gradients = _model.gradientBuffer();
+            buffer                   = std::copy_n(gradients.data(), gradients.NElems(), buffer);
+        }
+        else {
+            for(auto& weight : _model.weightsSortedByInsertion()) {
+                buffer = std::copy_n(weight->gradient().data(), weight->NElems(), buffer);
+            }
+        }
+        *buffer = loss->value();
+
+        _communicator.allreduce(_buffer.data(), _buffer.size());
+
+        TElem scale = TElem(1) / _communicator.size();
+        for(TElem& val : _buffer) {
+            val *= scale;
+        }
+
+        buffer = _buffer.data();
+        if(_model.isPacked()) {
+            Tensor<TElem>& gradients = _model.gradientBuffer();
+            std::copy_n(buffer, gradients.NElems(), gradients.data());
+            buffer += gradients.NElems();
+        }
+        else {
+            for(auto& weight : _model.weightsSortedByInsertion()) {
+                std::copy_n(buffer, weight->NElems(), weight->gradient().data());
+                buffer += weight->NElems();
+            }
+        }
+
+        optimizer.optimizeStep(loss);
+
+        _communicator.barrier();
+
+        return *buffer;
+    }
+};
+
+enum class CommunicationBackend
+{
+    SharedMemory,
+    Tcp
+};
+
+/*
+Fork num_processes worker processes, which run worker with a communicator of
+the chosen backend. The TCP backend connects the workers via loopback starting
+at base_port. The calling process only coordinates: It waits for all workers and
+throws std::runtime_error if one of them fails, after terminating the others.
+
+The threads of the global thread pool do not survive fork. The pool is hence
+stopped before forking and every worker starts its own pool with an equal
+share of the threads. model determines the buffer sizes of the shared memory.
+*/
+template<class TElem>
+void launchProcesses(size_t num_processes, Module<TElem>& model,
+                     std::function<void(Communicator<TElem>&)> worker,
+                     CommunicationBackend backend   = CommunicationBackend::SharedMemory,
+                     uint16_t             base_port = 29500)
+{
+    if(num_processes == 0) {
+        throw std::invalid_argument("launchProcesses: Need at least one process");
+    }
+
+    size_t capacity = 1;
+    for(auto& weight : model.weightsSortedByInsertion()) {
+        capacity += weight->NElems();
+    }
+    size_t broadcast_capacity = model.toByteArray().size();
+
+    std::shared_ptr<SharedMemoryRegion> region;
+    if(backend == CommunicationBackend::SharedMemory) {
+        region = SharedMemoryCommunicator<TElem>::createRegion(num_processes, capacity,
+                                                               broadcast_capacity);
+    }
+
+    size_t parent_threads = 0;
+    {
+        std::lock_guard<std::mutex> lock(globalThreadPoolMutex());
+        auto&                       pool = globalThreadPoolPtr();
+        if(pool) {
+            parent_threads = pool->numThreads();
+        }
+        pool.reset();
+    }
+    size_t threads_per_process = std::max(defaultNumThreads() / num_processes, size_t(1));
+
+    // Buffered output would be printed by every child otherwise
+    std::cout.flush();
+    std::cerr.flush();
+
+    std::vector<pid_t> children;
+
+    auto terminate_children = [&] {
+        for(pid_t child : children) {
+            if(child > 0) {
+                kill(child, SIGTERM);
+                waitpid(child, nullptr, 0);
+            }
+        }
+    };
+
+    for(size_t rank = 0; rank < num_processes; rank++) {
+        pid_t pid = fork();
+        if(pid < 0) {
+            terminate_children();
+            throw std::runtime_error("fork failed: " + std::string(std::strerror(errno)));
+        }
+        if(pid == 0) {
+            int status = 0;
+            try {
+                setNumThreads(threads_per_process);
+                if(backend == CommunicationBackend::SharedMemory) {
+                    SharedMemoryCommunicator<TElem> communicator(region, rank, num_processes,
+                                                                 capacity, broadcast_capacity);
+                    worker(communicator);
+                }
+                else {
+                    TcpCommunicator<TElem> communicator(
+                        rank, num_processes, std::vector<std::string>(num_processes, "127.0.0.1"),
+                        base_port);
+                    worker(communicator);
+                }
+            }
+            catch(const std::exception& e) {
+                std::cerr << "Worker " << rank << " failed: " << e.what() << std::endl;
+                status = 1;
+            }
+            catch(...) {
+                std::cerr << "Worker " << rank << " failed" << std::endl;
+                status = 1;
+            }
+            std::cout.flush();
+            // Skip the destructors of the objects inherited from the parent
+            _exit(status);
+        }
+        children.push_back(pid);
+    }
+
+    bool failed = false;
+    while(!failed && std::any_of(children.begin(), children.end(), [](pid_t child) {
+        return child > 0;
+    })) {
+        for(pid_t& child : children) {
+            int status = 0;
+            if(child > 0 && waitpid(child, &status, WNOHANG) == child) {
+                child = 0;
+                failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    terminate_children();
+
+    if(parent_threads > 0) {
+        setNumThreads(parent_threads);
+    }
+
+    if(failed) {
+        throw std::runtime_error("launchProcesses: A worker process failed");
+    }
+}
+
+} // namespace snnl
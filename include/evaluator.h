@@ -0,0 +1,122 @@
+#pragma once
+#include "forward_declare.h"
+#include "grad_mode.h"
+#include "module.h"
+#include "node.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace snnl
+{
+
+/*
+Runs a model over a data set in batches of batch_size samples and accumulates
+metrics of its outputs, e.g. ClassificationMetrics. No graph is built, so only
+the values of the batches in flight are held in memory.
+
+The batches are split among the threads, which call the model at the same
+time. Each of them accumulates its own metrics, which are merged at the end.
+The model must therefore not change its state when called, e.g. unlike the
+SimpleRNNModule. The threads are those of the global pool unless another pool
+is given. With an own pool, the model runs serially within each of its
+threads, so that the evaluation leaves the global pool to others. e.g.
+
+Evaluator<float> evaluator(model, 256);
+auto metrics = evaluator.evaluate(test_images, test_labels, ClassificationMetrics<float>(10));
+std::cout << "Test accuracy = " << metrics.accuracy() << std::endl;
+*/
+template<typename TElem>
+class Evaluator
+{
+    Module<TElem>& _model;
+    size_t         _batch_size;
+    ThreadPool*    _pool;
+
+    // Rows [begin, end) of tensor, copied only if the tensor is not contiguous
+    static Tensor<TElem> rows(Tensor<TElem> tensor, size_t begin, size_t end)
+    {
+        Index shape = tensor.shape();
+        shape[0]    = end - begin;
+        if(tensor.isContiguous()) {
+            return tensor.viewOfRange(begin * (tensor.NElems() / tensor.shape(0)), shape);
+        }
+
+        std::vector<size_t> indices(end - begin);
+        for(size_t i = 0; i < indices.size(); i++) {
+            indices[i] = begin + i;
+        }
+        Tensor<TElem> out(shape);
+        tensor.gatherRows(indices, out);
+        return out;
+    }
+
+public:
+    Evaluator(Module<TElem>& model, size_t batch_size = 256, ThreadPool* pool = nullptr)
+        : _model(model)
+        , _batch_size(batch_size)
+        , _pool(pool)
+    {
+        if(batch_size == 0) {
+            throw std::invalid_argument("Evaluator: Invalid batch size 0");
+        }
+    }
+
+    size_t batchSize() const { return _batch_size; }
+
+    // Feed the inputs batch by batch to the model and update metrics with the
+    // outputs and the matching labels. TMetrics needs the methods
+    // update(outputs, labels) and merge(other). metrics is the empty state
+    // every thread starts from
+    template<typename TMetrics>
+    TMetrics evaluate(const Tensor<TElem>& inputs, const Tensor<TElem>& labels,
+                      const TMetrics& metrics) const
+    {
+        if(inputs.NDims() == 0 || labels.NDims() == 0 || inputs.shape(0) != labels.shape(0)) {
+            throw std::invalid_argument("Evaluator: Number of inputs " + inputs.shape() +
+                                        " and labels " + labels.shape() + " differ");
+        }
+
+        size_t num_samples = inputs.shape(0);
+        size_t num_batches = (num_samples + _batch_size - 1) / _batch_size;
+
+        // Partial metrics by their first batch, merged in order
+        std::map<size_t, TMetrics> partial;
+        std::mutex                 mutex;
+
+        ThreadPool& pool = _pool ? *_pool : globalThreadPool();
+        pool.parallelFor(0, num_batches, [&](size_t batch_begin, size_t batch_end) {
+            NoGradGuard no_grad;
+            TMetrics    local = metrics;
+
+            std::optional<ThreadPool::SerialScope> serial;
+            if(_pool) {
+                serial.emplace();
+            }
+
+            for(size_t batch = batch_begin; batch < batch_end; batch++) {
+                size_t row_begin = batch * _batch_size;
+                size_t row_end   = std::min(row_begin + _batch_size, num_samples);
+
+                Tensor<TElem>    batch_inputs = rows(inputs, row_begin, row_end);
+                NodeShPtr<TElem> outputs      = _model.call(Node<TElem>::create(batch_inputs));
+                local.update(outputs->values(), rows(labels, row_begin, row_end));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            partial.emplace(batch_begin, std::move(local));
+        });
+
+        TMetrics out = metrics;
+        for(auto& [batch, local] : partial) {
+            out.merge(local);
+        }
+        return out;
+    }
+};
+
+} // namespace snnl
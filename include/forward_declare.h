@@ -16,6 +16,9 @@ class Node;
 template<class TElem>
 class Module;
 
+template<class TElem>
+class GraphExecutor;
+
 template<class TElem>
 using NodeShPtr = std::shared_ptr<Node<TElem>>;
 
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace snnl
+{
+
+// Whether connectors build graphs for the backward pass on the current thread
+inline bool& gradEnabled()
+{
+    static thread_local bool enabled = true;
+    return enabled;
+}
+
+/*
+Disables building graphs on the current thread while it exists. Connectors then
+only compute the values of their outputs, which are no part of a graph and have
+no gradient. Intermediate results are freed as soon as they are not used
+anymore, e.g. for evaluation
+
+{
+    NoGradGuard no_grad;
+    auto encodings = model.call(images);
+}
+*/
+class NoGradGuard
+{
+    bool _was_enabled;
+
+public:
+    NoGradGuard()
+        : _was_enabled(gradEnabled())
+    {
+        gradEnabled() = false;
+    }
+
+    NoGradGuard(const NoGradGuard&) = delete;
+
+    ~NoGradGuard() { gradEnabled() = _was_enabled; }
+};
+
+} // namespace snnl
@@ -0,0 +1,104 @@
+#pragma once
+#include "data_parallel_trainer.h"
+#include "forward_declare.h"
+#include "node.h"
+#include "optimizer.h"
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Gradient accumulation over several micro-batches with one optimizer step at the
+end. Allows effective batch sizes larger than what fits into memory at once.
+
+Every call to backward runs the backward pass of the loss of one micro-batch and
+adds the result to the gradients of the weights it reaches. After num_micro_batches calls,
+the optimizer updates the weights with the combined gradients. With
+LossReduction::Mean, the gradients are averaged over the micro-batches, which
+equals the gradient of the full batch if all micro-batches have the same size.
+e.g.
+
+GradientAccumulator<float> accumulator(optimizer, 4);
+for(size_t i = 0; i < 4; i++) {
+    auto [images, labels] = train_generator.generateBatch(32);
+    auto loss = SparseCategoricalCrosseEntropy(model.call(images), labels);
+    accumulator.backward(loss);
+}
+*/
+template<class TElem>
+class GradientAccumulator
+{
+    Optimizer<TElem>& _optimizer;
+    size_t            _num_micro_batches;
+    LossReduction     _reduction;
+
+    // Micro-batches since the last step and their combined loss
+    size_t _micro_batch = 0;
+    TElem  _loss        = 0;
+    TElem  _step_loss   = 0;
+
+    // Weights reached by any micro-batch since the last step
+    std::vector<NodeShPtr<TElem>>    _weights;
+    std::unordered_set<Node<TElem>*> _seen_weights;
+
+    TElem scale() const
+    {
+        return _reduction == LossReduction::Mean ? TElem(1) / _num_micro_batches : TElem(1);
+    }
+
+public:
+    GradientAccumulator(Optimizer<TElem>& optimizer, size_t num_micro_batches,
+                        LossReduction reduction = LossReduction::Mean)
+        : _optimizer(optimizer)
+        , _num_micro_batches(num_micro_batches)
+        , _reduction(reduction)
+    {
+        if(num_micro_batches == 0) {
+            throw std::invalid_argument("GradientAccumulator: Need at least one micro-batch");
+        }
+    }
+
+    size_t numMicroBatches() const { return _num_micro_batches; }
+
+    // Number of micro-batches accumulated since the last optimizer step
+    size_t numAccumulated() const { return _micro_batch; }
+
+    // Loss of the last optimizer step, combined like the gradients
+    TElem stepLoss() const { return _step_loss; }
+
+    // Accumulate the gradients of loss. Returns true if the optimizer updated
+    // the weights
+    bool backward(NodeShPtr<TElem> loss)
+    {
+        // Every weight starts from zero gradients in the first micro-batch
+        // reaching it, as the micro-batches may reach different weights
+        loss->iterateWeights([&](Node<TElem>& weight) {
+            if(_seen_weights.insert(&weight).second) {
+                weight.gradient().setAllValues(0);
+                _weights.push_back(weight.getPtr());
+            }
+        });
+        loss->accumulateGrad(scale());
+
+        _loss += scale() * loss->value();
+        _micro_batch++;
+
+        if(_micro_batch < _num_micro_batches) {
+            return false;
+        }
+
+        _optimizer.optimizeStep(_weights);
+        _weights.clear();
+        _seen_weights.clear();
+
+        _step_loss   = _loss;
+        _loss        = 0;
+        _micro_batch = 0;
+        return true;
+    }
+};
+
+} // namespace snnl
@@ -0,0 +1,280 @@
+#pragma once
+#include "connector.h"
+#include "forward_declare.h"
+#include "node.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Runs the graph below a root node (usually the loss) on the work stealing
+thread pool. Each connector call is one operation. An operation is dispatched as
+soon as the operations it depends on are done: In forward direction the
+producers of its inputs, in backward direction the consumers of its output.
+Independent branches like skip connections or several heads thus run
+concurrently, while the connectors themselves may still split their loops.
+
+The graph is captured once. forward() recomputes all values from the current
+values of the leaves (shapes must not change), backward() computes the same
+gradients as Node::computeGrad(). e.g.
+
+auto loss = model.call(input, labels);
+GraphExecutor<float> executor(loss);
+executor.backward();
+input->values() = next_input;
+executor.forward();
+*/
+template<class TElem>
+class GraphExecutor
+{
+    using SNodeConnection = typename Connector<TElem>::SNodeConnection;
+
+    struct Operation
+    {
+        Connector<TElem>* connector  = nullptr;
+        Node<TElem>*      output     = nullptr;
+        SNodeConnection*  connection = nullptr;
+
+        // Operations producing the inputs and consuming the output
+        std::vector<size_t> producers;
+        std::vector<size_t> consumers;
+
+        // Distinct input nodes consumed by other operations as well, as sorted
+        // indices into _nodes
+        std::vector<size_t> shared_inputs;
+
+        bool needs_grad = false;
+    };
+
+    NodeShPtr<TElem> _root;
+
+    // Topologically sorted: producers come before their consumers
+    std::vector<Operation> _operations;
+
+    std::vector<Node<TElem>*>                _nodes;
+    std::unordered_map<Node<TElem>*, size_t> _node_indices;
+    std::unordered_map<Node<TElem>*, size_t> _producers;
+
+    // Serializes the gradient accumulation of operations sharing an input
+    std::unique_ptr<std::mutex[]> _node_mutexes;
+
+    size_t captureNode(Node<TElem>* node)
+    {
+        auto it = _node_indices.find(node);
+        if(it != _node_indices.end()) {
+            return it->second;
+        }
+
+        size_t node_index = _nodes.size();
+        _nodes.push_back(node);
+        _node_indices[node] = node_index;
+
+        Connector<TElem>* connector = node->prevConnector();
+        if(!connector) {
+            return node_index;
+        }
+
+        Operation op;
+        op.connector  = connector;
+        op.output     = node;
+        op.connection = &connector->_node_connections.at(node);
+
+        for(auto& input : op.connection->input_nodes) {
+            op.shared_inputs.push_back(captureNode(input.get()));
+
+            auto producer = _producers.find(input.get());
+            if(producer != _producers.end()) {
+                op.producers.push_back(producer->second);
+            }
+        }
+
+        for(auto* indices : {&op.shared_inputs, &op.producers}) {
+            std::sort(indices->begin(), indices->end());
+            indices->erase(std::unique(indices->begin(), indices->end()), indices->end());
+        }
+
+        size_t op_index = _operations.size();
+        for(size_t producer : op.producers) {
+            _operations[producer].consumers.push_back(op_index);
+        }
+        _producers[node] = op_index;
+        _operations.push_back(std::move(op));
+
+        return node_index;
+    }
+
+    template<typename Func>
+    void execute(bool forward, Func run_operation)
+    {
+        size_t num_ops = _operations.size();
+
+        ThreadPool& pool = globalThreadPool();
+        if(pool.numThreads() == 1) {
+            for(size_t i = 0; i < num_ops; i++) {
+                run_operation(_operations[forward ? i : num_ops - 1 - i]);
+            }
+            return;
+        }
+
+        std::unique_ptr<std::atomic<size_t>[]> pending(new std::atomic<size_t>[num_ops]);
+        for(size_t i = 0; i < num_ops; i++) {
+            pending[i] =
+                forward ? _operations[i].producers.size() : _operations[i].consumers.size();
+        }
+
+        std::atomic<size_t> remaining = num_ops;
+        std::atomic<bool>   failed    = false;
+        std::mutex          error_mutex;
+        std::exception_ptr  error;
+
+        std::function<void(size_t)> dispatch = [&](size_t op_index) {
+            Operation& op = _operations[op_index];
+
+            // After a failure, the remaining operations are only counted down
+            if(!failed) {
+                try {
+                    run_operation(op);
+                }
+                catch(...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+
+            for(size_t next : forward ? op.consumers : op.producers) {
+                if(--pending[next] == 0) {
+                    pool.submit([&dispatch, next] {
+                        dispatch(next);
+                    });
+                }
+            }
+
+            // The caller may return as soon as remaining drops to zero
+            ThreadPool* pool_ptr = &pool;
+            if(--remaining == 0) {
+                pool_ptr->notifyWaiting();
+            }
+        };
+
+        // Collect the initial operations first. Once the first one runs, the
+        // counters of its successors may drop to zero as well
+        std::vector<size_t> ready;
+        for(size_t i = 0; i < num_ops; i++) {
+            if(pending[i] == 0) {
+                ready.push_back(i);
+            }
+        }
+        for(size_t op_index : ready) {
+            pool.submit([&dispatch, op_index] {
+                dispatch(op_index);
+            });
+        }
+
+        pool.waitUntil([&] {
+            return remaining == 0;
+        });
+
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+public:
+    explicit GraphExecutor(NodeShPtr<TElem> root)
+        : _root(root)
+    {
+        captureNode(_root.get());
+        _node_mutexes = std::make_unique<std::mutex[]>(_nodes.size());
+
+        std::vector<size_t> num_consumers(_nodes.size(), 0);
+        for(auto& op : _operations) {
+            for(size_t node_index : op.shared_inputs) {
+                num_consumers[node_index]++;
+            }
+        }
+        for(auto& op : _operations) {
+            auto& inputs = op.shared_inputs;
+            inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+                                        [&](size_t node_index) {
+                                            return num_consumers[node_index] < 2;
+                                        }),
+                         inputs.end());
+        }
+    }
+
+    GraphExecutor(const GraphExecutor&) = delete;
+
+    size_t numOperations() const { return _operations.size(); }
+
+    NodeShPtr<TElem>& root() { return _root; }
+
+    void forward()
+    {
+        execute(true, [](Operation& op) {
+            // Several connectors accumulate into their output
+            op.output->values().setAllValues(0);
+            op.connector->forwardHandler(op.connection->input_nodes, op.output);
+        });
+    }
+
+    void backward() { runBackward(1, false); }
+
+    // Same as Node::accumulateGrad: Adds to the gradients of the weights
+    void accumulateBackward(TElem scale = 1) { runBackward(scale, true); }
+
+private:
+    void runBackward(TElem scale, bool accumulate)
+    {
+        // Same pruning as Node::needsGradAbove: Only operations with a weight
+        // above need to compute gradients
+        for(auto& op : _operations) {
+            op.needs_grad = false;
+            for(auto& input : op.connection->input_nodes) {
+                auto producer = _producers.find(input.get());
+                op.needs_grad |= input->isWeight() || input->requiresGrad() ||
+                                 (producer != _producers.end() &&
+                                  _operations[producer->second].needs_grad);
+            }
+        }
+
+        parallelFor(0, _nodes.size(), [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++) {
+                if(!(accumulate && _nodes[i]->isWeight())) {
+                    _nodes[i]->gradient().setAllValues(0);
+                }
+            }
+        });
+        _root->gradient().setAllValues(scale);
+
+        execute(false, [this](Operation& op) {
+            if(!op.needs_grad) {
+                return;
+            }
+            if(op.shared_inputs.empty()) {
+                op.connector->backwardHandler(op.output, op.connection->input_nodes);
+                return;
+            }
+
+            // Lock in ascending order to avoid dead locks. Nested loops must
+            // not pick up other operations while the locks are held
+            std::vector<std::unique_lock<std::mutex>> locks;
+            for(size_t node_index : op.shared_inputs) {
+                locks.emplace_back(_node_mutexes[node_index]);
+            }
+            ThreadPool::SerialScope serial;
+            op.connector->backwardHandler(op.output, op.connection->input_nodes);
+        });
+    }
+};
+
+} // namespace snnl
@@ -0,0 +1,123 @@
+#pragma once
+#include "forward_declare.h"
+#include "module.h"
+#include "node.h"
+#include "optimizer.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Asynchronous training without any locks in the style of Hogwild!. Every worker
+owns a replica of the model and draws batches from its own BatchGenerator. The
+values of the replica weights share their memory with the model, only the
+gradients are separate. Each worker thus runs forward and backward on its own
+and applies its SGD update directly to the shared weights, while the other
+workers read and update them as well.
+
+Updates of different workers may interleave or overwrite each other. This is
+intended: For sparse inputs, the updates rarely touch the same weights and the
+lost updates do not harm convergence, while the workers never wait for each
+other. Use DataParallelTrainer if reproducible results are needed.
+
+Each worker runs on one thread of the pool. With more workers than threads,
+some threads run several workers one after another.
+*/
+template<class TElem>
+class HogwildTrainer
+{
+public:
+    using LossFunction =
+        std::function<NodeShPtr<TElem>(Module<TElem>&, std::vector<NodeShPtr<TElem>>)>;
+
+private:
+    Module<TElem>&                  _model;
+    std::vector<ModuleShPtr<TElem>> _replicas;
+    LossFunction                    _loss_function;
+    TElem                           _learning_rate;
+
+    Module<TElem>& replica(size_t index) { return index == 0 ? _model : *_replicas[index - 1]; }
+
+public:
+    HogwildTrainer(Module<TElem>& model, std::function<ModuleShPtr<TElem>()> make_replica,
+                   size_t num_workers, LossFunction loss_function, TElem learning_rate)
+        : _model(model)
+        , _loss_function(loss_function)
+        , _learning_rate(learning_rate)
+    {
+        if(num_workers == 0) {
+            throw std::invalid_argument("HogwildTrainer: Need at least one worker");
+        }
+
+        auto& weights = _model.weightsSortedByInsertion();
+        for(size_t i = 1; i < num_workers; i++) {
+            auto  replica         = make_replica();
+            auto& replica_weights = replica->weightsSortedByInsertion();
+
+            if(replica_weights.size() != weights.size()) {
+                throw std::invalid_argument(
+                    "HogwildTrainer: Replica differs in its number of weights");
+            }
+            for(size_t w = 0; w < weights.size(); w++) {
+                if(replica_weights[w]->shape() != weights[w]->shape()) {
+                    throw std::invalid_argument("HogwildTrainer: Weight shapes of the replica "
+                                                "differ: " +
+                                                replica_weights[w]->shape() + " vs. " +
+                                                weights[w]->shape());
+                }
+                replica_weights[w]->values().shareDataWith(weights[w]->values());
+            }
+            _replicas.push_back(replica);
+        }
+    }
+
+    HogwildTrainer(const HogwildTrainer&) = delete;
+
+    size_t numWorkers() const { return _replicas.size() + 1; }
+
+    Module<TElem>& model() { return _model; }
+
+    // Let worker i train num_steps batches from generators[i]. Returns the mean
+    // loss over all steps of all workers
+    template<typename TBatchGenerator>
+    TElem train(std::vector<TBatchGenerator>& generators, size_t batch_size, size_t num_steps)
+    {
+        if(generators.size() != numWorkers()) {
+            throw std::invalid_argument("HogwildTrainer: Need one batch generator per worker");
+        }
+
+        std::vector<TElem> loss_sums(numWorkers(), 0);
+
+        parallelFor(0, numWorkers(), [&](size_t worker_begin, size_t worker_end) {
+            for(size_t worker = worker_begin; worker < worker_end; worker++) {
+                // Optimizers are not thread safe. SGD has no state, so a
+                // separate instance per worker is equivalent to a shared one
+                SGDOptimizer<TElem> optimizer(_learning_rate);
+
+                for(size_t step = 0; step < num_steps; step++) {
+                    auto batch = generators[worker].generateBatch(batch_size);
+                    auto loss  = _loss_function(
+                        replica(worker), std::vector<NodeShPtr<TElem>>(batch.begin(), batch.end()));
+
+                    loss->computeGrad();
+                    optimizer.optimizeStep(loss);
+
+                    loss_sums[worker] += loss->value();
+                }
+            }
+        });
+
+        TElem loss_sum = 0;
+        for(TElem worker_loss : loss_sums) {
+            loss_sum += worker_loss;
+        }
+        return loss_sum / (numWorkers() * std::max(num_steps, size_t(1)));
+    }
+};
+
+} // namespace snnl
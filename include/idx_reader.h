@@ -0,0 +1,122 @@
+#pragma once
+#include "forward_declare.h"
+#include "mapped_file.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace snnl
+{
+
+// Values in IDX files are big endian
+template<typename T>
+T readBigEndian(const uint8_t* bytes)
+{
+    uint8_t swapped[sizeof(T)];
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    std::reverse_copy(bytes, bytes + sizeof(T), swapped);
+#else
+    std::copy_n(bytes, sizeof(T), swapped);
+#endif
+    T value;
+    std::memcpy(&value, swapped, sizeof(T));
+    return value;
+}
+
+// out[i] = value i * scale + offset, split among the threads. The loops of
+// single byte types vectorize
+template<typename TSource, typename TElem>
+void convertIDXValues(const uint8_t* payload, size_t size, TElem* out, TElem scale, TElem offset)
+{
+    parallelFor(
+        0, size,
+        [&](size_t begin, size_t end) {
+            if constexpr(sizeof(TSource) == 1) {
+                const TSource* values = reinterpret_cast<const TSource*>(payload);
+                for(size_t i = begin; i < end; i++) {
+                    out[i] = static_cast<TElem>(values[i]) * scale + offset;
+                }
+            }
+            else {
+                for(size_t i = begin; i < end; i++) {
+                    TSource value = readBigEndian<TSource>(payload + i * sizeof(TSource));
+                    out[i]        = static_cast<TElem>(value) * scale + offset;
+                }
+            }
+        },
+        PARALLEL_GRAIN_SIZE);
+}
+
+/*
+Read a file in the IDX format, e.g. the MNIST images and labels, into a tensor
+with the dimensions given in the file. The file is memory mapped and every
+value is converted to value * scale + offset. e.g.
+
+Tensor<float> images = readIDX<float>("train-images.idx3-ubyte", 1.f / 255);
+Tensor<float> labels = readIDX<float>("train-labels.idx1-ubyte");
+*/
+template<class TElem>
+Tensor<TElem> readIDX(const std::string& path, TElem scale = 1, TElem offset = 0)
+{
+    MappedFile     file(path);
+    const uint8_t* bytes = file.data();
+
+    // Magic number: Two zero bytes, the type of the values and the number of
+    // dimensions. Each dimension follows as 32 bit integer
+    if(file.size() < 4 || bytes[0] != 0 || bytes[1] != 0) {
+        throw std::runtime_error("readIDX: " + path + " is no IDX file");
+    }
+    uint8_t type     = bytes[2];
+    size_t  num_dims = bytes[3];
+    size_t  header   = 4 + 4 * num_dims;
+    if(num_dims == 0 || file.size() < header) {
+        throw std::runtime_error("readIDX: Invalid header in " + path);
+    }
+
+    std::vector<size_t> shape(num_dims);
+    size_t              size = 1;
+    for(size_t d = 0; d < num_dims; d++) {
+        shape[d] = readBigEndian<uint32_t>(bytes + 4 + 4 * d);
+        size *= shape[d];
+    }
+
+    Tensor<TElem> out(shape);
+
+    auto convert = [&](auto type_tag) {
+        using TSource = decltype(type_tag);
+        if(file.size() != header + size * sizeof(TSource)) {
+            throw std::runtime_error("readIDX: Size of " + path + " does not match its header");
+        }
+        convertIDXValues<TSource>(bytes + header, size, out.data(), scale, offset);
+    };
+
+    if(type == 0x08) {
+        convert(uint8_t());
+    }
+    else if(type == 0x09) {
+        convert(int8_t());
+    }
+    else if(type == 0x0B) {
+        convert(int16_t());
+    }
+    else if(type == 0x0C) {
+        convert(int32_t());
+    }
+    else if(type == 0x0D) {
+        convert(float());
+    }
+    else if(type == 0x0E) {
+        convert(double());
+    }
+    else {
+        throw std::runtime_error("readIDX: Unknown type " + std::to_string(type) + " in " + path);
+    }
+    return out;
+}
+
+} // namespace snnl
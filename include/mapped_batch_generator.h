@@ -0,0 +1,230 @@
+#pragma once
+#include "batch_generator_base.h"
+#include "forward_declare.h"
+#include "mapped_file.h"
+#include "node.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+namespace snnl
+{
+
+// Write the elements of tensor to path without any header, e.g. to prepare a
+// data set for the MappedBatchGenerator
+template<class TElem>
+void writeRawFile(const std::string& path, const Tensor<TElem>& tensor)
+{
+    if(!tensor.isContiguous()) {
+        throw std::invalid_argument("writeRawFile: Tensor has to be contiguous");
+    }
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(tensor.data()), tensor.NElems() * sizeof(TElem));
+    if(!file) {
+        throw std::runtime_error("writeRawFile: Writing " + path + " failed");
+    }
+}
+
+/*
+Batch generator for data sets larger than the memory. Every tensor of a sample
+is read from a memory mapped file holding the raw elements of all samples one
+after another (see writeRawFile). Only the pages of the samples in use are
+loaded.
+
+Instead of a full shuffle, the samples are split into blocks of block_size
+consecutive samples. Every pass over the data visits the blocks in random
+order and the samples of a block in random order. Reads thus stay local: While
+a block is in use, the next one is read ahead via madvise and the previous one
+is released. e.g.
+
+MappedBatchGenerator<float, 2> generator({"train_images.raw", "train_labels.raw"},
+                                         {{{28, 28}, {1}}});
+auto [images, labels] = generator.generateBatch(32);
+
+Offers the same interface as BatchGenerator, see BatchGeneratorBase.
+*/
+template<typename TElem, size_t NumTensors>
+class MappedBatchGenerator : public BatchGeneratorBase<TElem, NumTensors>
+{
+    std::array<std::unique_ptr<MappedFile>, NumTensors> _files;
+    std::array<Index, NumTensors>                       _sample_shapes;
+    std::array<size_t, NumTensors>                      _sample_sizes;
+
+    size_t _num_samples;
+    size_t _block_size;
+
+    // Blocks in the order of the current pass and the samples of the current
+    // block
+    std::vector<size_t> _block_order;
+    std::vector<size_t> _block_samples;
+    size_t              _current_block = 0;
+    size_t              _current_index = 0;
+
+    // Blocks passed by the current batch, released after it is copied
+    std::vector<size_t> _finished_blocks;
+
+    size_t numBlocks() const { return (_num_samples + _block_size - 1) / _block_size; }
+
+    void adviseBlock(size_t block, int advice) const
+    {
+        size_t sample_begin = block * _block_size;
+        size_t sample_end   = std::min(sample_begin + _block_size, _num_samples);
+        for(size_t i = 0; i < NumTensors; i++) {
+            size_t bytes = _sample_sizes[i] * sizeof(TElem);
+            _files[i]->advise(sample_begin * bytes, sample_end * bytes, advice);
+        }
+    }
+
+    void startBlock()
+    {
+        size_t block        = _block_order[_current_block];
+        size_t sample_begin = block * _block_size;
+        size_t sample_end   = std::min(sample_begin + _block_size, _num_samples);
+
+        _block_samples.resize(sample_end - sample_begin);
+        for(size_t i = 0; i < _block_samples.size(); i++) {
+            _block_samples[i] = sample_begin + i;
+        }
+        std::shuffle(_block_samples.begin(), _block_samples.end(), this->_rng);
+        _current_index = 0;
+
+        if(_current_block + 1 < _block_order.size()) {
+            adviseBlock(_block_order[_current_block + 1], MADV_WILLNEED);
+        }
+    }
+
+    virtual void reshuffle() override
+    {
+        std::shuffle(_block_order.begin(), _block_order.end(), this->_rng);
+        _current_block = 0;
+        startBlock();
+    }
+
+    void nextSample()
+    {
+        _current_index++;
+        if(_current_index < _block_samples.size()) {
+            return;
+        }
+
+        _finished_blocks.push_back(_block_order[_current_block]);
+        _current_block++;
+        if(_current_block >= _block_order.size()) {
+            reshuffle();
+        }
+        else {
+            startBlock();
+        }
+    }
+
+    // Epochs do not interrupt the pass over the blocks
+    virtual std::vector<size_t> nextIndices(size_t batch_size) override
+    {
+        std::vector<size_t> indices(batch_size);
+
+        for(size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+            indices[batch_index] = _block_samples[_current_index];
+
+            nextSample();
+            this->countSample();
+        }
+        return indices;
+    }
+
+    virtual void gather(const std::vector<size_t>&             indices,
+                        std::array<Tensor<TElem>*, NumTensors> batch) override
+    {
+        for(size_t i = 0; i < NumTensors; i++) {
+            if(batch[i]->shape(0) != indices.size() || !batch[i]->isContiguous() ||
+               batch[i]->NElems() != indices.size() * _sample_sizes[i])
+            {
+                throw std::invalid_argument("MappedBatchGenerator: Batch tensor of shape " +
+                                            batch[i]->shape() + " does not fit the samples");
+            }
+        }
+
+        // Page faults of different rows are served concurrently
+        parallelFor(0, indices.size(), [&](size_t row_begin, size_t row_end) {
+            for(size_t i = 0; i < NumTensors; i++) {
+                size_t       size   = _sample_sizes[i];
+                const TElem* source = reinterpret_cast<const TElem*>(_files[i]->data());
+                TElem*       target = batch[i]->data();
+                for(size_t row = row_begin; row < row_end; row++) {
+                    std::copy_n(source + indices[row] * size, size, target + row * size);
+                }
+            }
+        });
+
+        for(size_t block : _finished_blocks) {
+            if(block != _block_order[_current_block]) {
+                adviseBlock(block, MADV_DONTNEED);
+            }
+        }
+        _finished_blocks.clear();
+    }
+
+public:
+    MappedBatchGenerator(const std::array<std::string, NumTensors>&         paths,
+                         const std::array<std::vector<size_t>, NumTensors>& sample_shapes,
+                         size_t                                             block_size = 1024)
+        : _block_size(std::max(block_size, size_t(1)))
+    {
+        for(size_t i = 0; i < NumTensors; i++) {
+            _files[i] = std::make_unique<MappedFile>(paths[i]);
+
+            _sample_shapes[i] = Index(sample_shapes[i].size());
+            _sample_sizes[i]  = 1;
+            for(size_t d = 0; d < sample_shapes[i].size(); d++) {
+                _sample_shapes[i][d] = sample_shapes[i][d];
+                _sample_sizes[i] *= sample_shapes[i][d];
+            }
+
+            size_t sample_bytes = _sample_sizes[i] * sizeof(TElem);
+            if(sample_bytes == 0 || _files[i]->size() % sample_bytes != 0) {
+                throw std::domain_error("MappedBatchGenerator: Size of " + paths[i] +
+                                        " is no multiple of the sample size");
+            }
+            size_t num_samples = _files[i]->size() / sample_bytes;
+            if(i > 0 && num_samples != _num_samples) {
+                throw std::domain_error("Dimensions of tensors mismatch");
+            }
+            _num_samples = num_samples;
+        }
+        if(_num_samples == 0) {
+            throw std::domain_error("MappedBatchGenerator: No samples");
+        }
+        this->setNumSamples(_num_samples);
+
+        _block_order.resize(numBlocks());
+        for(size_t block = 0; block < _block_order.size(); block++) {
+            _block_order[block] = block;
+        }
+        reshuffle();
+    }
+
+    size_t numSamples() const { return _num_samples; }
+
+    virtual std::array<Tensor<TElem>, NumTensors> allocateBatch(size_t batch_size) const override
+    {
+        std::array<Tensor<TElem>, NumTensors> out;
+
+        for(size_t i = 0; i < NumTensors; i++) {
+            Index shape_out(_sample_shapes[i].size() + 1);
+            shape_out[0] = batch_size;
+            for(size_t d = 0; d < _sample_shapes[i].size(); d++) {
+                shape_out[d + 1] = _sample_shapes[i][d];
+            }
+            out[i] = Tensor<TElem>(shape_out);
+        }
+        return out;
+    }
+};
+
+} // namespace snnl
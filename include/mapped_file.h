@@ -0,0 +1,77 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace snnl
+{
+
+// Read only memory mapping of a whole file. Pages are loaded lazily by the
+// kernel when they are accessed
+class MappedFile
+{
+    const uint8_t* _data = nullptr;
+    size_t         _size = 0;
+
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            throw std::runtime_error("open " + path + " failed: " + std::strerror(errno));
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("fstat " + path + " failed: " + std::strerror(errno));
+        }
+        _size = info.st_size;
+
+        if(_size > 0) {
+            void* ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(ptr == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("mmap " + path + " failed: " + std::strerror(errno));
+            }
+            _data = static_cast<const uint8_t*>(ptr);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if(_data) {
+            munmap(const_cast<uint8_t*>(_data), _size);
+        }
+    }
+
+    const uint8_t* data() const { return _data; }
+
+    size_t size() const { return _size; }
+
+    // Hint the kernel how the bytes [begin, end) will be accessed, e.g.
+    // MADV_WILLNEED to read them ahead or MADV_DONTNEED to drop them. The
+    // range is extended to whole pages
+    void advise(size_t begin, size_t end, int advice) const
+    {
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+        begin = begin / page_size * page_size;
+        end   = std::min(end, _size);
+        if(begin < end) {
+            madvise(const_cast<uint8_t*>(_data) + begin, end - begin, advice);
+        }
+    }
+};
+
+} // namespace snnl
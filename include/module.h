@@ -1,13 +1,19 @@
 #pragma once
+#include "checkpoint.h"
 #include "connector.h"
 #include "forward_declare.h"
 #include "tools.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <optional>
 #include <pthread.h>
 #include <set>
 #include <stdexcept>
+#include <string>
 #include <sys/types.h>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace snnl
@@ -26,6 +32,16 @@ protected:
 
     std::set<ModuleShPtr<TElem>> _modules;
 
+    // Vector of above in the order of addModule
+    std::vector<ModuleShPtr<TElem>> _modulesSortedByInsertion;
+
+    // Flat buffers with the values and gradients of all weights in insertion
+    // order after packParameters. For child modules, these are views into the
+    // buffers of the packed parent
+    bool          _is_packed = false;
+    Tensor<TElem> _parameter_buffer;
+    Tensor<TElem> _gradient_buffer;
+
     NodeShPtr<TElem> addWeight(const std::initializer_list<size_t>& shape)
     {
         return addWeight(Index{shape});
@@ -58,6 +74,8 @@ protected:
         for(auto weight : module->_weightsSortedByInsertion) {
             insertWeight(weight);
         }
+        _modules.emplace(module);
+        _modulesSortedByInsertion.push_back(module);
         return module;
     }
 
@@ -65,76 +83,223 @@ protected:
 
     Module() = default;
 
+    // Use the part of the buffers, which holds the own weights. Stays unpacked
+    // if the weights are not consecutive there, e.g. due to weights shared with
+    // other modules
+    void adoptBuffers(Tensor<TElem>& parameter_buffer, Tensor<TElem>& gradient_buffer,
+                      const std::unordered_map<Node<TElem>*, size_t>& offsets)
+    {
+        _is_packed = false;
+        _parameter_buffer.shareDataWith(Tensor<TElem>());
+        _gradient_buffer.shareDataWith(Tensor<TElem>());
+
+        size_t begin = 0;
+        if(!_weightsSortedByInsertion.empty()) {
+            begin = offsets.at(_weightsSortedByInsertion.front().get());
+        }
+
+        size_t end         = begin;
+        bool   consecutive = true;
+        for(auto& weight : _weightsSortedByInsertion) {
+            consecutive &= offsets.at(weight.get()) == end;
+            end += weight->NElems();
+        }
+
+        if(consecutive) {
+            std::vector<size_t> shape{end - begin};
+            _parameter_buffer.shareDataWith(parameter_buffer.viewOfRange(begin, shape));
+            _gradient_buffer.shareDataWith(gradient_buffer.viewOfRange(begin, shape));
+            _is_packed = true;
+        }
+
+        for(auto& module : _modulesSortedByInsertion) {
+            module->adoptBuffers(parameter_buffer, gradient_buffer, offsets);
+        }
+    }
+
 public:
+    // Shapes and values of all weights one after another, the layout of the
+    // former file format
     std::vector<uint8_t> toByteArray()
     {
-        std::vector<uint8_t> out;
-        for(auto weight : _weightsSortedByInsertion) {
-            auto values = weight->values().toByteArray();
-            out.insert(out.end(), values.begin(), values.end());
+        size_t size = 0;
+        for(auto& weight : _weightsSortedByInsertion) {
+            size += (weight->NDims() + 1) * sizeof(size_t) + weight->NElems() * sizeof(TElem);
+        }
+
+        std::vector<uint8_t> out(size);
+        uint8_t*             ptr = out.data();
+        for(auto& weight : _weightsSortedByInsertion) {
+            auto shape = weight->shape().toByteArray();
+            ptr        = std::copy(shape.begin(), shape.end(), ptr);
+
+            Tensor<TElem> values = weight->values();
+            if(!values.isContiguous()) {
+                values.shareDataWith(values.copy());
+            }
+            std::memcpy(ptr, values.data(), values.NElems() * sizeof(TElem));
+            ptr += values.NElems() * sizeof(TElem);
         }
         return out;
     }
 
     void fromByteArray(const std::vector<uint8_t>& array)
     {
-        auto currentVec = array;
-        auto begin      = array.begin();
-        auto end        = array.end();
-        for(auto& weight : _weightsSortedByInsertion) {
-
-            Tensor<TElem> weight_read;
-
-            size_t bytes_read = weight_read.fromByteArray(begin, end);
+        fromByteArray(array.data(), array.data() + array.size());
+    }
 
-            if(weight->values().shape() != weight_read.shape()) {
+    // Copy the values of every weight straight out of the bytes
+    void fromByteArray(const uint8_t* begin, const uint8_t* end)
+    {
+        for(auto& weight : _weightsSortedByInsertion) {
+            if(size_t(end - begin) < sizeof(size_t)) {
+                throw std::range_error("fromByteArray: Invalid array size");
+            }
+            Index shape;
+            begin += shape.fromByteArray(begin, end);
 
-                std::cout << "Tensor incompatible with target: " << weight_read.shape()
+            if(weight->values().shape() != shape) {
+                std::cout << "Tensor incompatible with target: " << shape
                           << std::string(" vs. ") << weight->values().shape();
                 throw std::domain_error("Tensor incompatible with target");
             }
-            weight->values() = weight_read;
-            begin += bytes_read;
+
+            size_t size = weight->NElems() * sizeof(TElem);
+            if(size_t(end - begin) < size) {
+                throw std::range_error("fromByteArray: Invalid array size");
+            }
+            Tensor<TElem>& values = weight->values();
+            if(values.isContiguous()) {
+                std::memcpy(values.data(), begin, size);
+            }
+            else {
+                Tensor<TElem> weight_read(shape);
+                std::memcpy(weight_read.data(), begin, size);
+                values = weight_read;
+            }
+            begin += size;
         }
     }
 
-    void saveToFile(std::string file_name)
+    // Names of the weights in checkpoints, by insertion order
+    std::vector<std::string> weightNames() const
     {
+        std::vector<std::string> names;
+        for(size_t w = 0; w < _weightsSortedByInsertion.size(); w++) {
+            names.push_back("weight" + std::to_string(w));
+        }
+        return names;
+    }
 
+    // Write the weights as checkpoint, see checkpoint.h
+    void saveToFile(std::string file_name)
+    {
         file_name = append_if_not_endswith(file_name, ".snnl");
 
-        std::ofstream out(file_name);
+        std::vector<Tensor<TElem>> values;
+        for(auto& weight : _weightsSortedByInsertion) {
+            values.push_back(weight->values());
+        }
+        writeCheckpoint(file_name, weightNames(), values);
+    }
+
+    // Load a checkpoint by mapping it into memory. Files of the former format,
+    // without a header, are still read
+    void loadFromFile(std::string file_name)
+    {
+        file_name = append_if_not_endswith(file_name, ".snnl");
 
-        if(not out.is_open()) {
-            throw std::invalid_argument("Could not open " + file_name);
+        std::optional<MappedFile> file;
+        try {
+            file.emplace(file_name);
+        }
+        catch(const std::runtime_error& e) {
+            throw std::invalid_argument("Could not open " + file_name + ": " + e.what());
         }
 
-        auto bytes = toByteArray();
-        for(auto val : bytes) {
-            out << val;
+        if(!isCheckpoint(*file)) {
+            fromByteArray(file->data(), file->data() + file->size());
+            return;
         }
 
-        out.close();
+        std::vector<Tensor<TElem>> values;
+        for(auto& weight : _weightsSortedByInsertion) {
+            values.push_back(weight->values());
+        }
+        readCheckpoint(*file, file_name, weightNames(), values);
     }
 
-    void loadFromFile(std::string file_name)
+    /*
+    Move the values and gradients of all weights, including those of the child
+    modules, into one flat parameter buffer and one flat gradient buffer. The
+    weights become views into these buffers and keep their values. Operations
+    on all weights, like zeroing the gradients, then run as one linear pass
+    over parameterBuffer() or gradientBuffer().
+
+    Call it after all weights and child modules were added and before the
+    weights are shared with other tensors, e.g. by HogwildTrainer. Weights
+    added later are not part of the buffers until packParameters is called
+    again.
+    */
+    void packParameters()
     {
-        file_name = append_if_not_endswith(file_name, ".snnl");
+        std::unordered_map<Node<TElem>*, size_t> offsets;
+
+        size_t size = 0;
+        for(auto& weight : _weightsSortedByInsertion) {
+            offsets[weight.get()] = size;
+            size += weight->NElems();
+        }
 
-        std::ifstream ifs(file_name);
+        Tensor<TElem> parameter_buffer(std::vector<size_t>{size});
+        Tensor<TElem> gradient_buffer(std::vector<size_t>{size});
 
-        if(not ifs.is_open()) {
-            throw std::invalid_argument("Could not open " + file_name);
+        for(auto& weight : _weightsSortedByInsertion) {
+            size_t offset   = offsets[weight.get()];
+            auto   values   = parameter_buffer.viewOfRange(offset, weight->shape());
+            auto   gradient = gradient_buffer.viewOfRange(offset, weight->shape());
+
+            values   = weight->values();
+            gradient = weight->gradient();
+
+            weight->values().shareDataWith(values);
+            weight->gradient().shareDataWith(gradient);
         }
 
-        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(ifs)),
-                                   std::istreambuf_iterator<char>());
+        adoptBuffers(parameter_buffer, gradient_buffer, offsets);
+    }
+
+    bool isPacked() const { return _is_packed; }
 
-        fromByteArray(bytes);
+    // Flat buffer with the values of all weights. Only valid if isPacked()
+    Tensor<TElem>& parameterBuffer() { return _parameter_buffer; }
+
+    // Flat buffer with the gradients of all weights. Only valid if isPacked()
+    Tensor<TElem>& gradientBuffer() { return _gradient_buffer; }
+
+    void zeroGradients()
+    {
+        if(_is_packed) {
+            std::fill_n(_gradient_buffer.data(), _gradient_buffer.NElems(), TElem(0));
+            return;
+        }
+        for(auto& weight : _weightsSortedByInsertion) {
+            weight->gradient().setAllValues(0);
+        }
     }
 
     const std::set<NodeShPtr<TElem>>& weights() { return _weights; }
 
+    const std::vector<NodeShPtr<TElem>>& weightsSortedByInsertion()
+    {
+        return _weightsSortedByInsertion;
+    }
+
+    const std::vector<ModuleShPtr<TElem>>& modulesSortedByInsertion()
+    {
+        return _modulesSortedByInsertion;
+    }
+
     NodeShPtr<TElem> call(std::vector<NodeShPtr<TElem>> prev_nodes)
     {
         return callHandler(prev_nodes);
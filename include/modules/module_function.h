@@ -0,0 +1,38 @@
+#pragma once
+#include "forward_declare.h"
+#include "module.h"
+#include <functional>
+#include <stdexcept>
+
+namespace snnl
+{
+
+// Module without weights, which applies a fixed function like an activation.
+// Lets a sequential model consist of its children only, e.g.
+// addModule<FunctionModule>(Sigmoid<float>)
+template<class TElem>
+class FunctionModule : public Module<TElem>
+{
+
+    std::function<NodeShPtr<TElem>(const NodeShPtr<TElem>&)> _function;
+
+public:
+    FunctionModule(std::function<NodeShPtr<TElem>(const NodeShPtr<TElem>&)> function)
+        : _function(function)
+    {
+    }
+
+    virtual NodeShPtr<TElem> callHandler(std::vector<NodeShPtr<TElem>> inputs) override
+    {
+        if(inputs.size() != 1) {
+            throw std::invalid_argument("Maximal one node per call for function module");
+        }
+
+        return _function(inputs.at(0));
+    }
+};
+
+template<typename TElem>
+using FunctionModuleShPtr = std::shared_ptr<FunctionModule<TElem>>;
+
+} // namespace snnl
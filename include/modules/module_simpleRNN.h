@@ -3,7 +3,9 @@
 #include "connectors/connector_dense.h"
 #include "forward_declare.h"
 #include "module.h"
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 namespace snnl
 {
@@ -49,6 +51,61 @@ public:
         return h;
     }
 
+    /*
+    Run a time-major batch of sequences inputs {steps, batch, input units} from
+    a zero state, e.g. of a SequenceBatch. The rows are sorted by decreasing
+    lengths. A row is only computed for the steps within its sequence: Output t
+    holds the states of the first rows with lengths > t, the padding is skipped.
+    Afterwards the state is zero again, as after construction
+    */
+    std::vector<NodeShPtr<TElem>> callSequence(Tensor<TElem>              inputs,
+                                               const std::vector<size_t>& lengths)
+    {
+        if(inputs.NDims() != 3 || inputs.shape(1) != lengths.size() ||
+           inputs.shape(2) != _input_units || !inputs.isContiguous())
+        {
+            throw std::invalid_argument("SimpleRNN: Invalid sequence batch of shape " +
+                                        inputs.shape());
+        }
+        if(!std::is_sorted(lengths.rbegin(), lengths.rend()) ||
+           (!lengths.empty() && lengths[0] > inputs.shape(0)))
+        {
+            throw std::invalid_argument("SimpleRNN: Lengths have to be decreasing and fit the "
+                                        "steps of the batch");
+        }
+
+        _h_prev = Node<TElem>::create({_output_units});
+        _h_prev->setAllValues(0);
+
+        std::vector<NodeShPtr<TElem>> outputs;
+        size_t                        num_active = lengths.size();
+        size_t                        steps      = lengths.empty() ? 0 : lengths[0];
+        for(size_t step = 0; step < steps; step++) {
+            while(lengths[num_active - 1] <= step) {
+                num_active--;
+            }
+
+            // The state continues in the first rows of the last output, the
+            // finished rows are dropped. It is a new node, so that the outputs
+            // keep their graphs for a loss over all steps
+            if(step > 0) {
+                Tensor<TElem> state = outputs.back()->values().viewOfRange(
+                    0, std::vector<size_t>{num_active, _output_units});
+                _h_prev = Node<TElem>::create(state);
+            }
+
+            Tensor<TElem> x = inputs.viewOfRange(step * lengths.size() * _input_units,
+                                                 std::vector<size_t>{num_active, _input_units});
+            outputs.push_back(this->call(Node<TElem>::create(x)));
+        }
+
+        // The state holds only the rows of the last step, which would not fit
+        // the next call
+        _h_prev = Node<TElem>::create({_output_units});
+        _h_prev->setAllValues(0);
+        return outputs;
+    }
+
     NodeShPtr<TElem>& W_h() { return _W_h; }
     NodeShPtr<TElem>& W_x() { return _W_x; }
 
@@ -14,13 +14,17 @@ class Node : public std::enable_shared_from_this<Node<TElem>>
 {
 
     friend class Connector<TElem>;
-    friend class Connector<TElem>;
+    friend class GraphExecutor<TElem>;
 
     Tensor<TElem> _values;
     Tensor<TElem> _gradient;
 
     bool _is_weight = false;
 
+    // Leaves which need a gradient although they are no weights, e.g. the
+    // input of a pipeline stage
+    bool _requires_grad = false;
+
     ConnectorShPtr<TElem> _prev_connector = nullptr;
 
     // Extra variables for tracking the backward call.
@@ -93,7 +97,7 @@ public:
 
     void setAllGrad(const TElem& grad) { _gradient.setAllValues(grad); }
 
-    Connector<TElem>* prevConnector() { return _prev_connector; }
+    Connector<TElem>* prevConnector() { return _prev_connector.get(); }
 
     virtual ~Node() { disconnect(); }
 
@@ -108,6 +112,28 @@ public:
         }
     }
 
+    // Continue the backward pass of a graph which was split into several parts.
+    // gradient is the gradient of the final output with respect to this node,
+    // as computed by the following part
+    void computeGrad(const Tensor<TElem>& gradient) { computeGradFrom(gradient, false); }
+
+    // Same as computeGrad, but adds to the gradients of the weights instead of
+    // resetting them first. Allows to sum the gradients of several losses, e.g.
+    // of micro-batches, before an optimizer step. The gradient of this node is
+    // set to scale
+    void accumulateGrad(TElem scale = 1)
+    {
+        needsGradAbove(nullptr, true);
+
+        _gradient.setAllValues(scale);
+
+        if(_prev_connector) {
+            _prev_connector->backward(this);
+        }
+    }
+
+    void accumulateGrad(const Tensor<TElem>& gradient) { computeGradFrom(gradient, true); }
+
     void zeroGrad()
     {
         iterateNodes([](Node<TElem>& node) {
@@ -200,6 +226,10 @@ public:
 
     void setWeight(bool val) { _is_weight = val; }
 
+    bool requiresGrad() const { return _requires_grad; }
+
+    void setRequiresGrad(bool val) { _requires_grad = val; }
+
     long NDims() const { return _values.NDims(); }
 
     void disconnect()
@@ -236,6 +266,22 @@ protected:
         _gradient.setDims(t.shape());
     }
 
+    void computeGradFrom(const Tensor<TElem>& gradient, bool accumulate)
+    {
+        if(gradient.shape() != shape()) {
+            throw std::invalid_argument("computeGrad: Shape of gradient " + gradient.shape() +
+                                        " does not match node shape " + shape());
+        }
+
+        needsGradAbove(nullptr, accumulate);
+
+        _gradient = gradient;
+
+        if(_prev_connector) {
+            _prev_connector->backward(this);
+        }
+    }
+
     void backward()
     {
         _backward_calls++;
@@ -252,23 +298,25 @@ protected:
         }
     }
 
-    bool needsGradAbove(Node<TElem>* next_node = nullptr)
+    // Resets the gradients of all nodes above, except those of the weights if
+    // accumulate is set
+    bool needsGradAbove(Node<TElem>* next_node = nullptr, bool accumulate = false)
     {
         if(next_node) {
             if(_connected_nodes.find(next_node) != _connected_nodes.end()) {
                 // Already came along this edge. Stop here
                 return _needs_grad;
             }
-            if(_connected_nodes.empty()) {
+            if(_connected_nodes.empty() && !(accumulate && _is_weight)) {
                 _gradient.setAllValues(static_cast<TElem>(0));
             }
             _connected_nodes.emplace(next_node);
         }
 
-        bool needs_grad = _is_weight;
+        bool needs_grad = _is_weight || _requires_grad;
 
         if(_prev_connector) {
-            needs_grad |= _prev_connector->needsGradAbove(this);
+            needs_grad |= _prev_connector->needsGradAbove(this, accumulate);
         }
 
         _needs_grad = needs_grad;
@@ -1,68 +1,523 @@
 #pragma once
 #include "forward_declare.h"
 #include "module.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
 
 namespace snnl
 {
 
+// Sum of term(i) for i in [0, size). Uses independent partial sums, so that
+// the loop vectorizes although the additions are not reordered
+template<typename TElem, typename TFunc>
+TElem vectorizedSum(size_t size, TFunc term)
+{
+    constexpr size_t lanes = 8;
+
+    TElem  partial[lanes] = {};
+    size_t i              = 0;
+    for(; i + lanes <= size; i += lanes) {
+        for(size_t lane = 0; lane < lanes; lane++) {
+            partial[lane] += term(i + lane);
+        }
+    }
+
+    TElem sum = 0;
+    for(; i < size; i++) {
+        sum += term(i);
+    }
+    for(size_t lane = 0; lane < lanes; lane++) {
+        sum += partial[lane];
+    }
+    return sum;
+}
+
+// Number of consecutive state elements sharing one scale in 8-bit states
+constexpr size_t QUANTIZATION_BLOCK_SIZE = 256;
+
+static_assert(PARALLEL_GRAIN_SIZE % QUANTIZATION_BLOCK_SIZE == 0,
+              "Chunks of the optimizer have to consist of whole blocks");
+
+enum class StatePrecision
+{
+    Full,
+    // 8 bits per element with one scale per block. Dynamic quantization of
+    // Dettmers et al., 8-bit Optimizers via Block-wise Quantization
+    Blockwise8Bit
+};
+
+// Code book of the dynamic 8-bit quantization. Decade i in 1e-6 ... 1 is split
+// into 2^i steps (2^(i+1) without sign), so that small values keep their
+// relative precision. Sorted, includes 0 and 1
+template<typename TElem>
+const std::array<TElem, 256>& dynamicQuantizationMap(bool is_signed)
+{
+    static const std::array<std::array<TElem, 256>, 2> maps = [] {
+        std::array<std::array<TElem, 256>, 2> out;
+        for(bool with_sign : {false, true}) {
+            std::vector<double> data = {0, 1};
+            for(int i = 0; i < 7; i++) {
+                double decade = std::pow(10., i - 6);
+                size_t steps  = with_sign ? size_t(1) << i : size_t(2) << i;
+                for(size_t j = 0; j < steps; j++) {
+                    // Center of step j in [0.1, 1]
+                    double mean = 0.1 + 0.9 * (j + 0.5) / steps;
+                    data.push_back(decade * mean);
+                    if(with_sign) {
+                        data.push_back(-decade * mean);
+                    }
+                }
+            }
+            std::sort(data.begin(), data.end());
+            std::copy(data.begin(), data.end(), out[with_sign].begin());
+        }
+        return out;
+    }();
+    return maps[is_signed];
+}
+
+// Index of the entry of the sorted map closest to value
+template<typename TElem>
+uint8_t nearestCode(const std::array<TElem, 256>& map, TElem value)
+{
+    auto it = std::lower_bound(map.begin(), map.end(), value);
+    if(it == map.end()) {
+        return 255;
+    }
+    if(it != map.begin() && value - *(it - 1) < *it - value) {
+        --it;
+    }
+    return it - map.begin();
+}
+
 template<typename TElem>
 class Optimizer
 {
 
-    int _num_states_per_weight;
+    // Part of a single weight. A step updates the chunks of all weights in one
+    // parallel loop, so that small weights do not leave threads idle
+    struct Chunk
+    {
+        size_t slot;
+        size_t begin;
+        size_t end;
+    };
+
+    size_t _num_states_per_weight;
 
-    // momenta etc
-    std::map<NodeShPtr<TElem>, std::vector<Tensor<TElem>>> _states;
+    // Sums over all elements of a weight, which layer-wise optimizers need
+    // before the update, e.g. squared norms
+    size_t _num_sums_per_weight;
 
-    virtual void optimizeGrad(Node<TElem>& weight, std::vector<Tensor<TElem>>& states) = 0;
+    // Weights the optimizer is bound to. The position of a weight is its slot
+    std::vector<NodeShPtr<TElem>> _weights;
+
+    // momenta etc. One buffer per kind of state, holding the states of all
+    // bound weights one after another in the order of their slots
+    std::vector<std::vector<TElem>> _states;
+
+    // The same for 8-bit states: Codes into the map per element and the
+    // absolute maximum per block
+    StatePrecision                              _state_precision = StatePrecision::Full;
+    std::vector<std::vector<uint8_t>>           _state_codes;
+    std::vector<std::vector<TElem>>             _state_scales;
+    std::vector<const std::array<TElem, 256>*> _state_maps;
+
+    // Offset of the states of each slot in the buffers above. Multiples of
+    // QUANTIZATION_BLOCK_SIZE for 8-bit states
+    std::vector<size_t> _state_offsets;
+
+    std::vector<Chunk> _chunks;
+
+    // Weights updated by a step and their chunks. All bound weights after
+    // bind, a subset when a loss leads to only some of them
+    std::vector<NodeShPtr<TElem>> _step_weights;
+    std::vector<size_t>           _step_chunks;
+
+    // Sums per chunk and per slot
+    std::vector<TElem> _chunk_sums;
+    std::vector<TElem> _sums;
+
+    // Called once per step before any weight is updated
+    virtual void beginStep() {}
+
+    // First pass of layer-wise optimizers over size consecutive elements of a
+    // weight. Adds the partial sums of these elements to sums
+    virtual void sumRange(const TElem*, const TElem*, TElem* const*, size_t, TElem*) {}
+
+    // Update size consecutive elements of a weight. states[k] points to the
+    // k-th state of the first element, sums to the sums of the whole weight
+    virtual void optimizeRange(TElem* values, const TElem* gradient, TElem* const* states,
+                               const TElem* sums, size_t size) = 0;
+
+    // Whether state k can be negative. Unsigned states use all codes for
+    // positive values
+    virtual bool isStateSigned(size_t) const { return true; }
+
+    void dequantizeStates(size_t k, size_t begin, size_t size, TElem* out) const
+    {
+        const auto&    map   = *_state_maps[k];
+        const uint8_t* codes = _state_codes[k].data() + begin;
+        const TElem*   scale = _state_scales[k].data() + begin / QUANTIZATION_BLOCK_SIZE;
+
+        for(size_t i = 0; i < size; i++) {
+            out[i] = map[codes[i]] * scale[i / QUANTIZATION_BLOCK_SIZE];
+        }
+    }
+
+    void quantizeStates(size_t k, size_t begin, size_t size, const TElem* values)
+    {
+        const auto& map   = *_state_maps[k];
+        uint8_t*    codes = _state_codes[k].data() + begin;
+        TElem*      scale = _state_scales[k].data() + begin / QUANTIZATION_BLOCK_SIZE;
+
+        for(size_t block = 0; block * QUANTIZATION_BLOCK_SIZE < size; block++) {
+            size_t block_begin = block * QUANTIZATION_BLOCK_SIZE;
+            size_t block_end   = std::min(block_begin + QUANTIZATION_BLOCK_SIZE, size);
+
+            TElem absmax = 0;
+            for(size_t i = block_begin; i < block_end; i++) {
+                absmax = std::max(absmax, std::abs(values[i]));
+            }
+            scale[block] = absmax;
+
+            TElem inverse = absmax > 0 ? 1 / absmax : 0;
+            for(size_t i = block_begin; i < block_end; i++) {
+                codes[i] = nearestCode(map, values[i] * inverse);
+            }
+        }
+    }
+
+    // Call func(chunk, values, gradient, states) for the chunks of the step in
+    // parallel.
+    // 8-bit states are dequantized into a buffer per thread before and
+    // quantized again afterwards, so that they stay in cache in between
+    template<typename TFunc>
+    void forEachChunk(TFunc func)
+    {
+        bool quantized = _state_precision == StatePrecision::Blockwise8Bit;
+
+        parallelFor(0, _step_chunks.size(), [&](size_t chunk_begin, size_t chunk_end) {
+            size_t              buffer_size = quantized ? PARALLEL_GRAIN_SIZE : 0;
+            std::vector<TElem*> states(_num_states_per_weight);
+            std::vector<TElem>  buffer(_num_states_per_weight * buffer_size);
+
+            for(size_t i = chunk_begin; i < chunk_end; i++) {
+                size_t       c           = _step_chunks[i];
+                const Chunk& chunk       = _chunks[c];
+                Node<TElem>& weight      = *_weights[chunk.slot];
+                size_t       state_begin = _state_offsets[chunk.slot] + chunk.begin;
+                size_t       size        = chunk.end - chunk.begin;
+
+                for(size_t k = 0; k < _num_states_per_weight; k++) {
+                    if(quantized) {
+                        states[k] = buffer.data() + k * buffer_size;
+                        dequantizeStates(k, state_begin, size, states[k]);
+                    }
+                    else {
+                        states[k] = _states[k].data() + state_begin;
+                    }
+                }
+
+                func(c, weight.values().data() + chunk.begin,
+                     weight.gradient().data() + chunk.begin, states.data());
+
+                if(quantized) {
+                    for(size_t k = 0; k < _num_states_per_weight; k++) {
+                        quantizeStates(k, state_begin, size, states[k]);
+                    }
+                }
+            }
+        });
+    }
 
 public:
-    Optimizer(int num_states_per_weight)
+    Optimizer(size_t num_states_per_weight, size_t num_sums_per_weight = 0)
         : _num_states_per_weight(num_states_per_weight)
+        , _num_sums_per_weight(num_sums_per_weight)
+        , _states(num_states_per_weight)
     {
     }
 
-    void optimizeStep(NodeShPtr<TElem> loss)
+    virtual ~Optimizer() = default;
+
+    /*
+    Store the states, e.g. the moments of Adam, in full precision or with 8
+    bits per element. Has to be set before the first step:
+
+    AdamOptimizer<float> optimizer;
+    optimizer.setStatePrecision(StatePrecision::Blockwise8Bit);
+    */
+    void setStatePrecision(StatePrecision precision)
     {
-        loss->iterateWeights([&](Node<TElem>& weight) {
-            NodeShPtr<TElem> weight_ptr = weight.getPtr();
+        if(!_weights.empty()) {
+            throw std::runtime_error(
+                "Optimizer: State precision has to be set before the first step");
+        }
+        _state_precision = precision;
+    }
+
+    StatePrecision statePrecision() const { return _state_precision; }
+
+    // Number of bytes used by the states of all bound weights
+    size_t stateBytes() const
+    {
+        size_t bytes = 0;
+        for(auto& state : _states) {
+            bytes += state.size() * sizeof(TElem);
+        }
+        for(size_t k = 0; k < _state_codes.size(); k++) {
+            bytes += _state_codes[k].size() + _state_scales[k].size() * sizeof(TElem);
+        }
+        return bytes;
+    }
+
+    /*
+    Bind the optimizer to the given weights, e.g. model.weightsSortedByInsertion().
+    States of weights, which were bound before, are kept. Afterwards
+    optimizeStep() updates these weights without walking the graph:
+
+    AdamOptimizer<float> optimizer;
+    optimizer.bind(model.weightsSortedByInsertion());
+    ...
+    loss->computeGrad();
+    optimizer.optimizeStep();
+    */
+    void bind(const std::vector<NodeShPtr<TElem>>& weights)
+    {
+        std::unordered_map<Node<TElem>*, size_t> old_slots;
+        for(size_t slot = 0; slot < _weights.size(); slot++) {
+            old_slots[_weights[slot].get()] = slot;
+        }
 
-            auto& states = _states[weight_ptr];
+        bool   quantized = _state_precision == StatePrecision::Blockwise8Bit;
+        size_t num_states = _num_states_per_weight;
 
-            if(states.empty() && _num_states_per_weight > 0) {
-                states.resize(_num_states_per_weight);
-                for(auto& t : states) {
-                    t.setDims(weight.shape());
-                    t.setAllValues(0);
+        std::vector<std::vector<TElem>>   states(quantized ? 0 : num_states);
+        std::vector<std::vector<uint8_t>> state_codes(quantized ? num_states : 0);
+        std::vector<std::vector<TElem>>   state_scales(quantized ? num_states : 0);
+        std::vector<size_t>               state_offsets;
+        std::vector<Chunk>                chunks;
+
+        _state_maps.clear();
+        for(size_t k = 0; k < num_states; k++) {
+            _state_maps.push_back(&dynamicQuantizationMap<TElem>(isStateSigned(k)));
+        }
+
+        size_t offset = 0;
+        for(size_t slot = 0; slot < weights.size(); slot++) {
+            size_t size = weights[slot]->NElems();
+
+            // Every weight starts with a new block
+            if(quantized) {
+                offset = (offset + QUANTIZATION_BLOCK_SIZE - 1) / QUANTIZATION_BLOCK_SIZE *
+                         QUANTIZATION_BLOCK_SIZE;
+            }
+
+            auto old_slot = old_slots.find(weights[slot].get());
+            for(size_t k = 0; k < num_states; k++) {
+                if(quantized) {
+                    size_t num_blocks = (size + QUANTIZATION_BLOCK_SIZE - 1) /
+                                        QUANTIZATION_BLOCK_SIZE;
+                    uint8_t zero_code = nearestCode(*_state_maps[k], TElem(0));
+
+                    state_codes[k].resize(offset + size, zero_code);
+                    state_scales[k].resize(offset / QUANTIZATION_BLOCK_SIZE + num_blocks, 0);
+
+                    if(old_slot != old_slots.end()) {
+                        size_t old_offset = _state_offsets[old_slot->second];
+                        std::copy_n(_state_codes[k].begin() + old_offset, size,
+                                    state_codes[k].begin() + offset);
+                        std::copy_n(_state_scales[k].begin() +
+                                        old_offset / QUANTIZATION_BLOCK_SIZE,
+                                    num_blocks,
+                                    state_scales[k].begin() + offset / QUANTIZATION_BLOCK_SIZE);
+                    }
+                }
+                else {
+                    states[k].resize(offset + size, 0);
+                    if(old_slot != old_slots.end()) {
+                        auto old_state = _states[k].begin() + _state_offsets[old_slot->second];
+                        std::copy(old_state, old_state + size, states[k].begin() + offset);
+                    }
                 }
             }
 
-            optimizeGrad(weight, states);
+            for(size_t begin = 0; begin < size; begin += PARALLEL_GRAIN_SIZE) {
+                chunks.push_back({slot, begin, std::min(begin + PARALLEL_GRAIN_SIZE, size)});
+            }
+
+            state_offsets.push_back(offset);
+            offset += size;
+        }
+
+        _weights       = weights;
+        _states        = std::move(states);
+        _state_codes   = std::move(state_codes);
+        _state_scales  = std::move(state_scales);
+        _state_offsets = std::move(state_offsets);
+        _chunks        = std::move(chunks);
+
+        _chunk_sums.resize(_chunks.size() * _num_sums_per_weight);
+        _sums.resize(_weights.size() * _num_sums_per_weight);
+
+        _step_weights = _weights;
+        _step_chunks.resize(_chunks.size());
+        std::iota(_step_chunks.begin(), _step_chunks.end(), 0);
+    }
+
+    // Let the steps update only the given weights. Weights not bound yet are
+    // bound, the others keep their states for later steps
+    void selectStepWeights(const std::vector<NodeShPtr<TElem>>& weights)
+    {
+        std::unordered_map<Node<TElem>*, size_t> slots;
+        for(size_t slot = 0; slot < _weights.size(); slot++) {
+            slots[_weights[slot].get()] = slot;
+        }
+
+        std::vector<NodeShPtr<TElem>> all_weights = _weights;
+        for(auto& weight : weights) {
+            if(!slots.count(weight.get())) {
+                slots[weight.get()] = all_weights.size();
+                all_weights.push_back(weight);
+            }
+        }
+        if(all_weights.size() != _weights.size()) {
+            bind(all_weights);
+        }
+
+        std::vector<bool> selected(_weights.size(), false);
+        for(auto& weight : weights) {
+            selected[slots.at(weight.get())] = true;
+        }
+
+        _step_weights = weights;
+        _step_chunks.clear();
+        for(size_t c = 0; c < _chunks.size(); c++) {
+            if(selected[_chunks[c].slot]) {
+                _step_chunks.push_back(c);
+            }
+        }
+    }
+
+    const std::vector<NodeShPtr<TElem>>& boundWeights() const { return _weights; }
+
+    // Update the bound weights, or those of the last step with a loss or a list
+    // of weights
+    void optimizeStep()
+    {
+        beginStep();
+
+        size_t num_sums = _num_sums_per_weight;
+
+        if(num_sums > 0) {
+            std::fill(_chunk_sums.begin(), _chunk_sums.end(), TElem(0));
+            forEachChunk([&](size_t c, TElem* values, TElem* gradient, TElem* const* states) {
+                sumRange(values, gradient, states, _chunks[c].end - _chunks[c].begin,
+                         _chunk_sums.data() + c * num_sums);
+            });
+
+            // In the order of the chunks, so that the sums do not depend on the
+            // number of threads
+            std::fill(_sums.begin(), _sums.end(), TElem(0));
+            for(size_t c : _step_chunks) {
+                for(size_t k = 0; k < num_sums; k++) {
+                    _sums[_chunks[c].slot * num_sums + k] += _chunk_sums[c * num_sums + k];
+                }
+            }
+        }
+
+        forEachChunk([&](size_t c, TElem* values, TElem* gradient, TElem* const* states) {
+            const Chunk& chunk = _chunks[c];
+            optimizeRange(values, gradient, states, _sums.data() + chunk.slot * num_sums,
+                          chunk.end - chunk.begin);
+        });
+    }
+
+    // Update the weights the loss depends on. The graph is walked in every
+    // step, as losses may lead to different weights, e.g. the alternating
+    // losses of a generator and a discriminator. Use bind and optimizeStep()
+    // to skip the walk
+    void optimizeStep(NodeShPtr<TElem> loss)
+    {
+        std::vector<NodeShPtr<TElem>> weights;
+        loss->iterateWeights([&](Node<TElem>& weight) {
+            weights.push_back(weight.getPtr());
         });
+        optimizeStep(weights);
+    }
+
+    // Update the given weights. Needed if the graph of a single loss does not
+    // lead to all weights, e.g. when it was split into pipeline stages
+    void optimizeStep(const std::vector<NodeShPtr<TElem>>& weights)
+    {
+        if(weights != _step_weights) {
+            selectStepWeights(weights);
+        }
+        optimizeStep();
     }
 };
 
+/*
+Stochastic gradient descent, optionally with momentum:
+
+v = momentum * v + g
+w = w - learning_rate * v                     (default)
+w = w - learning_rate * (g + momentum * v)    (nesterov)
+*/
 template<typename TElem>
 class SGDOptimizer : public Optimizer<TElem>
 {
 
     TElem _learning_rate;
+    TElem _momentum;
+    bool  _nesterov;
 
-    virtual void optimizeGrad(Node<TElem>& weight, std::vector<Tensor<TElem>>&) override
+    virtual void optimizeRange(TElem* values, const TElem* gradient, TElem* const* states,
+                               const TElem*, size_t size) override
     {
-        auto weight_vals = weight.values().flatten();
-        auto weight_grad = weight.gradient().flatten();
+        const TElem learning_rate = _learning_rate;
+        const TElem momentum      = _momentum;
 
-        for(size_t ind = 0; ind < weight_vals.size(); ind++) {
-            weight_vals(ind) = weight_vals(ind) - _learning_rate * weight_grad(ind);
+        if(momentum == 0) {
+            for(size_t i = 0; i < size; i++) {
+                values[i] -= learning_rate * gradient[i];
+            }
+            return;
+        }
+
+        TElem* velocity = states[0];
+        if(_nesterov) {
+            for(size_t i = 0; i < size; i++) {
+                velocity[i] = momentum * velocity[i] + gradient[i];
+                values[i] -= learning_rate * (gradient[i] + momentum * velocity[i]);
+            }
+        }
+        else {
+            for(size_t i = 0; i < size; i++) {
+                velocity[i] = momentum * velocity[i] + gradient[i];
+                values[i] -= learning_rate * velocity[i];
+            }
         }
     }
 
 public:
-    SGDOptimizer(TElem learning_rate)
-        : Optimizer<TElem>::Optimizer(0)
+    SGDOptimizer(TElem learning_rate, TElem momentum = 0, bool nesterov = false)
+        : Optimizer<TElem>::Optimizer(momentum == 0 ? 0 : 1)
         , _learning_rate(learning_rate)
+        , _momentum(momentum)
+        , _nesterov(nesterov)
     {
+        if(nesterov && momentum == 0) {
+            throw std::invalid_argument("SGDOptimizer: Nesterov momentum requires momentum > 0");
+        }
     }
 };
 
@@ -76,29 +531,41 @@ class AdamOptimizer : public Optimizer<TElem>
 
     size_t _t = 0;
 
-    virtual void optimizeGrad(Node<TElem>& weight, std::vector<Tensor<TElem>>& states) override
-    {
+    // Bias corrections of the current step, folded into the step size and
+    // the second moment
+    TElem _step_size;
+    TElem _v_correction;
 
+    // The second moment is never negative
+    virtual bool isStateSigned(size_t k) const override { return k == 0; }
+
+    virtual void beginStep() override
+    {
         _t++;
+        _step_size    = _alpha / (1 - std::pow(_beta_1, _t));
+        _v_correction = 1 / (1 - std::pow(_beta_2, _t));
+    }
 
-        auto theta_t = weight.values().flatten();
-        auto g_t     = weight.gradient().flatten();
+    virtual void optimizeRange(TElem* theta_t, const TElem* g_t, TElem* const* states,
+                               const TElem*, size_t size) override
+    {
+        TElem* m_t = states[0];
+        TElem* v_t = states[1];
 
-        auto m_t = states[0].flatten();
-        auto v_t = states[1].flatten();
+        // Local copies, so that the compiler does not reload them after every store
+        const TElem beta_1       = _beta_1;
+        const TElem beta_2       = _beta_2;
+        const TElem step_size    = _step_size;
+        const TElem v_correction = _v_correction;
 
-        // Save memory by reallocating every step. Better preallocate for performance?
-        Tensor<TElem> v_t_hat(v_t.shape());
-        Tensor<TElem> m_t_hat(m_t.shape());
+        for(size_t i = 0; i < size; i++) {
+            TElem g = g_t[i];
+            TElem m = beta_1 * m_t[i] + (1 - beta_1) * g;
+            TElem v = beta_2 * v_t[i] + (1 - beta_2) * g * g;
 
-        for(size_t ind = 0; ind < theta_t.size(); ind++) {
-            m_t(ind)     = _beta_1 * m_t(ind) + (1 - _beta_1) * g_t(ind);
-            v_t(ind)     = _beta_2 * v_t(ind) + (1 - _beta_2) * g_t(ind) * g_t(ind);
-            m_t_hat(ind) = m_t(ind) / (1 - std::pow(_beta_1, _t));
-            v_t_hat(ind) = v_t(ind) / (1 - std::pow(_beta_2, _t));
-            theta_t(ind) =
-                theta_t(ind) -
-                _alpha * m_t_hat(ind) / (sqrt(std::max(v_t_hat(ind), TElem(0))) + TElem(1.e-8));
+            m_t[i] = m;
+            v_t[i] = v;
+            theta_t[i] -= step_size * m / (std::sqrt(v * v_correction) + TElem(1.e-8));
         }
     }
 
@@ -112,4 +579,157 @@ public:
     }
 };
 
+/*
+LAMB (You et al., Large Batch Optimization for Deep Learning): Adam with
+weight decay, whose update r of each weight is rescaled by the trust ratio
+||w|| / ||r||. Every weight thus changes by about the same fraction, which
+keeps training stable for very large batches
+*/
+template<typename TElem>
+class LAMBOptimizer : public Optimizer<TElem>
+{
+
+    TElem _alpha;
+    TElem _beta_1;
+    TElem _beta_2;
+    TElem _weight_decay;
+    TElem _epsilon;
+
+    size_t _t = 0;
+
+    TElem _m_correction;
+    TElem _v_correction;
+
+    virtual bool isStateSigned(size_t k) const override { return k == 0; }
+
+    virtual void beginStep() override
+    {
+        _t++;
+        _m_correction = 1 / (1 - std::pow(_beta_1, _t));
+        _v_correction = 1 / (1 - std::pow(_beta_2, _t));
+    }
+
+    // Adam update including weight decay, from the already updated moments
+    TElem update(TElem theta, TElem m, TElem v) const
+    {
+        return m * _m_correction / (std::sqrt(v * _v_correction) + _epsilon) +
+               _weight_decay * theta;
+    }
+
+    // Updates the moments. sums are ||w||^2 and ||r||^2
+    virtual void sumRange(const TElem* theta_t, const TElem* g_t, TElem* const* states,
+                          size_t size, TElem* sums) override
+    {
+        TElem* m_t = states[0];
+        TElem* v_t = states[1];
+
+        const TElem beta_1 = _beta_1;
+        const TElem beta_2 = _beta_2;
+        for(size_t i = 0; i < size; i++) {
+            m_t[i] = beta_1 * m_t[i] + (1 - beta_1) * g_t[i];
+            v_t[i] = beta_2 * v_t[i] + (1 - beta_2) * g_t[i] * g_t[i];
+        }
+
+        sums[0] += vectorizedSum<TElem>(size, [&](size_t i) {
+            return theta_t[i] * theta_t[i];
+        });
+        sums[1] += vectorizedSum<TElem>(size, [&](size_t i) {
+            TElem r = update(theta_t[i], m_t[i], v_t[i]);
+            return r * r;
+        });
+    }
+
+    virtual void optimizeRange(TElem* theta_t, const TElem*, TElem* const* states,
+                               const TElem* sums, size_t size) override
+    {
+        const TElem* m_t = states[0];
+        const TElem* v_t = states[1];
+
+        TElem weight_norm = std::sqrt(sums[0]);
+        TElem update_norm = std::sqrt(sums[1]);
+        TElem trust_ratio = weight_norm > 0 && update_norm > 0 ? weight_norm / update_norm : 1;
+        TElem step_size   = _alpha * trust_ratio;
+
+        for(size_t i = 0; i < size; i++) {
+            theta_t[i] -= step_size * update(theta_t[i], m_t[i], v_t[i]);
+        }
+    }
+
+public:
+    LAMBOptimizer(TElem alpha = 0.001, TElem beta_1 = 0.9, TElem beta_2 = 0.999,
+                  TElem weight_decay = 0.01, TElem epsilon = 1e-6)
+        : Optimizer<TElem>::Optimizer(2, 2)
+        , _alpha(alpha)
+        , _beta_1(beta_1)
+        , _beta_2(beta_2)
+        , _weight_decay(weight_decay)
+        , _epsilon(epsilon)
+    {
+    }
+};
+
+/*
+LARS (You et al., Large Batch Training of Convolutional Networks): SGD with
+momentum and weight decay, where each weight gets its own learning rate
+
+local_rate = eta * ||w|| / (||g|| + weight_decay * ||w||)
+v = momentum * v + learning_rate * local_rate * (g + weight_decay * w)
+w = w - v
+*/
+template<typename TElem>
+class LARSOptimizer : public Optimizer<TElem>
+{
+
+    TElem _learning_rate;
+    TElem _momentum;
+    TElem _weight_decay;
+    TElem _eta;
+
+    // sums are ||w||^2 and ||g||^2
+    virtual void sumRange(const TElem* values, const TElem* gradient, TElem* const*, size_t size,
+                          TElem* sums) override
+    {
+        sums[0] += vectorizedSum<TElem>(size, [&](size_t i) {
+            return values[i] * values[i];
+        });
+        sums[1] += vectorizedSum<TElem>(size, [&](size_t i) {
+            return gradient[i] * gradient[i];
+        });
+    }
+
+    virtual void optimizeRange(TElem* values, const TElem* gradient, TElem* const* states,
+                               const TElem* sums, size_t size) override
+    {
+        TElem* velocity = states[0];
+
+        TElem weight_norm = std::sqrt(sums[0]);
+        TElem grad_norm   = std::sqrt(sums[1]);
+        TElem local_rate  = 1;
+        if(weight_norm > 0 && grad_norm > 0) {
+            local_rate = _eta * weight_norm / (grad_norm + _weight_decay * weight_norm);
+        }
+
+        const TElem step_size    = _learning_rate * local_rate;
+        const TElem momentum     = _momentum;
+        const TElem weight_decay = _weight_decay;
+
+        for(size_t i = 0; i < size; i++) {
+            velocity[i] = momentum * velocity[i] +
+                          step_size * (gradient[i] + weight_decay * values[i]);
+            values[i] -= velocity[i];
+        }
+    }
+
+public:
+    LARSOptimizer(TElem learning_rate, TElem momentum = 0.9, TElem weight_decay = 0.0005,
+                  TElem eta = 0.001)
+        : Optimizer<TElem>::Optimizer(1, 2)
+        , _learning_rate(learning_rate)
+        , _momentum(momentum)
+        , _weight_decay(weight_decay)
+        , _eta(eta)
+    {
+    }
+};
+
 } // namespace snnl
\ No newline at end of file
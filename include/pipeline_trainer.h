@@ -0,0 +1,326 @@
+#pragma once
+#include "data_parallel_trainer.h"
+#include "forward_declare.h"
+#include "module.h"
+#include "node.h"
+#include "optimizer.h"
+#include "tensor.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Pipeline parallel training of a sequential model. The children of the model
+(in the order of addModule) are split into consecutive stages with about the
+same number of weights, and each stage runs on its own thread. The model has to
+be the chain of its children, activations can be added as FunctionModule.
+
+Every trainStep splits the batch into micro-batches along the first axis and
+follows the GPipe schedule: All micro-batches run forward through the stages,
+then backward in reverse order, then the optimizer updates all weights once.
+While stage s works on micro-batch m, stage s + 1 already works on m - 1.
+
+At a stage boundary, the input of a stage is a new leaf node, which shares the
+values of the previous stage's output and requires a gradient. The backward
+pass of the previous stage is continued from that gradient via
+Node::accumulateGrad(gradient), which sums up the gradients of the
+micro-batches in the weights.
+
+The first batch tensor is the input of the first child. The loss function gets
+the output of the last child and the remaining batch tensors. e.g.
+
+PipelineTrainer<float> trainer(
+    model, 4, 8,
+    [](NodeShPtr<float> output, std::vector<NodeShPtr<float>> targets) {
+        return MSE(output, targets[0]);
+    });
+float loss = trainer.trainStep({input, target}, optimizer);
+*/
+template<class TElem>
+class PipelineTrainer
+{
+public:
+    using LossFunction =
+        std::function<NodeShPtr<TElem>(NodeShPtr<TElem>, std::vector<NodeShPtr<TElem>>)>;
+
+private:
+    struct Stage
+    {
+        std::vector<ModuleShPtr<TElem>> modules;
+        std::vector<NodeShPtr<TElem>>   weights;
+
+        // Input and output node per micro-batch
+        std::vector<NodeShPtr<TElem>> inputs;
+        std::vector<NodeShPtr<TElem>> outputs;
+    };
+
+    std::vector<Stage> _stages;
+
+    // Weights of all stages, the optimizer is bound to them
+    std::vector<NodeShPtr<TElem>> _weights;
+
+    size_t        _num_micro_batches;
+    LossFunction  _loss_function;
+    LossReduction _reduction;
+
+    // Number of micro-batches each stage has finished in the current step
+    std::vector<size_t>     _forward_done;
+    std::vector<size_t>     _backward_done;
+    bool                    _failed = false;
+    std::exception_ptr      _error;
+    std::mutex              _mutex;
+    std::condition_variable _condition;
+
+    // Returns false if another stage failed
+    bool waitFor(std::vector<size_t>& done, size_t stage, size_t count)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [&] {
+            return _failed || done[stage] >= count;
+        });
+        return !_failed;
+    }
+
+    void finish(std::vector<size_t>& done, size_t stage)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            done[stage]++;
+        }
+        _condition.notify_all();
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(!_error) {
+                _error = error;
+            }
+            _failed = true;
+        }
+        _condition.notify_all();
+    }
+
+    void runStage(size_t s, const std::vector<std::vector<NodeShPtr<TElem>>>& micro_batches,
+                  const std::vector<TElem>& scales, std::vector<TElem>& losses)
+    {
+        Stage& stage      = _stages[s];
+        bool   last_stage = s + 1 == _stages.size();
+        size_t num_micro  = micro_batches.size();
+
+        for(auto& weight : stage.weights) {
+            weight->gradient().setAllValues(0);
+        }
+
+        for(size_t m = 0; m < num_micro; m++) {
+            NodeShPtr<TElem> input;
+            if(s == 0) {
+                input = micro_batches[m][0];
+            }
+            else {
+                if(!waitFor(_forward_done, s - 1, m + 1)) {
+                    return;
+                }
+                // Shares the values of the previous stage's output
+                input = Node<TElem>::create(_stages[s - 1].outputs[m]->values());
+                input->setRequiresGrad(true);
+            }
+
+            NodeShPtr<TElem> output = input;
+            for(auto& module : stage.modules) {
+                output = module->call(output);
+            }
+            if(last_stage) {
+                std::vector<NodeShPtr<TElem>> targets(micro_batches[m].begin() + 1,
+                                                      micro_batches[m].end());
+                output    = _loss_function(output, targets);
+                losses[m] = output->value();
+            }
+
+            stage.inputs[m]  = input;
+            stage.outputs[m] = output;
+            finish(_forward_done, s);
+        }
+
+        for(size_t k = 0; k < num_micro; k++) {
+            size_t m = num_micro - 1 - k;
+            if(last_stage) {
+                stage.outputs[m]->accumulateGrad(scales[m]);
+            }
+            else {
+                if(!waitFor(_backward_done, s + 1, k + 1)) {
+                    return;
+                }
+                stage.outputs[m]->accumulateGrad(_stages[s + 1].inputs[m]->gradient());
+            }
+            finish(_backward_done, s);
+        }
+    }
+
+public:
+    PipelineTrainer(Module<TElem>& model, size_t num_stages, size_t num_micro_batches,
+                    LossFunction loss_function, LossReduction reduction = LossReduction::Mean)
+        : _num_micro_batches(std::max(num_micro_batches, size_t(1)))
+        , _loss_function(loss_function)
+        , _reduction(reduction)
+    {
+        auto& children = model.modulesSortedByInsertion();
+        if(num_stages == 0 || children.size() < num_stages) {
+            throw std::invalid_argument("PipelineTrainer: Cannot split " +
+                                        std::to_string(children.size()) + " modules into " +
+                                        std::to_string(num_stages) + " stages");
+        }
+
+        // Balance the stages by their number of weights. Modules without
+        // weights count as one. A module joins the current stage if that brings
+        // the stage closer to its share of the total
+        std::vector<size_t> costs;
+        size_t              total_cost = 0;
+        for(auto& child : children) {
+            size_t cost = 0;
+            for(auto& weight : child->weightsSortedByInsertion()) {
+                cost += weight->NElems();
+            }
+            costs.push_back(std::max(cost, size_t(1)));
+            total_cost += costs.back();
+        }
+
+        size_t child = 0;
+        size_t cost  = 0;
+        for(size_t s = 0; s < num_stages; s++) {
+            size_t remaining_stages = num_stages - 1 - s;
+            size_t target_cost      = total_cost * (s + 1) / num_stages;
+
+            Stage stage;
+            while(child < children.size() - remaining_stages &&
+                  (stage.modules.empty() || remaining_stages == 0 ||
+                   2 * cost + costs[child] <= 2 * target_cost))
+            {
+                stage.modules.push_back(children[child]);
+                cost += costs[child];
+                child++;
+            }
+            for(auto& module : stage.modules) {
+                for(auto& weight : module->weightsSortedByInsertion()) {
+                    stage.weights.push_back(weight);
+                    _weights.push_back(weight);
+                }
+            }
+            _stages.push_back(std::move(stage));
+        }
+    }
+
+    PipelineTrainer(const PipelineTrainer&) = delete;
+
+    size_t numStages() const { return _stages.size(); }
+
+    // Modules of the given stage
+    const std::vector<ModuleShPtr<TElem>>& stageModules(size_t stage) const
+    {
+        return _stages.at(stage).modules;
+    }
+
+    // Run one training step on the given batch and return its loss
+    TElem trainStep(const std::vector<NodeShPtr<TElem>>& batch, Optimizer<TElem>& optimizer)
+    {
+        if(batch.empty()) {
+            throw std::invalid_argument("PipelineTrainer: Empty batch");
+        }
+        size_t batch_size = batch[0]->shape(0);
+        for(auto& node : batch) {
+            if(node->shape(0) != batch_size) {
+                throw std::invalid_argument("PipelineTrainer: Batch sizes of inputs differ");
+            }
+        }
+        if(batch_size == 0) {
+            throw std::invalid_argument("PipelineTrainer: Empty batch");
+        }
+
+        size_t num_micro = std::min(_num_micro_batches, batch_size);
+
+        std::vector<std::vector<NodeShPtr<TElem>>> micro_batches(num_micro);
+        std::vector<TElem>                         scales(num_micro);
+        std::vector<TElem>                         losses(num_micro);
+
+        for(size_t m = 0; m < num_micro; m++) {
+            size_t row_begin = batch_size * m / num_micro;
+            size_t row_end   = batch_size * (m + 1) / num_micro;
+
+            for(auto& node : batch) {
+                Index shape = node->shape();
+                shape[0]    = row_end - row_begin;
+
+                auto micro      = Node<TElem>::create(shape);
+                micro->values() = node->values().viewAs(range(row_begin, row_end), ellipsis());
+                micro_batches[m].push_back(micro);
+            }
+
+            scales[m] = _reduction == LossReduction::Mean
+                            ? static_cast<TElem>(row_end - row_begin) / batch_size
+                            : TElem(1);
+        }
+
+        _forward_done.assign(_stages.size(), 0);
+        _backward_done.assign(_stages.size(), 0);
+        _failed = false;
+        _error  = nullptr;
+        for(auto& stage : _stages) {
+            stage.inputs.assign(num_micro, nullptr);
+            stage.outputs.assign(num_micro, nullptr);
+        }
+
+        auto run = [&](size_t s) {
+            try {
+                runStage(s, micro_batches, scales, losses);
+            }
+            catch(...) {
+                fail(std::current_exception());
+            }
+        };
+
+        // The first stage runs on the calling thread
+        std::vector<std::thread> threads;
+        for(size_t s = 1; s < _stages.size(); s++) {
+            threads.emplace_back(run, s);
+        }
+        run(0);
+        for(auto& thread : threads) {
+            thread.join();
+        }
+
+        for(auto& stage : _stages) {
+            stage.inputs.clear();
+            stage.outputs.clear();
+        }
+
+        if(_error) {
+            std::rethrow_exception(_error);
+        }
+
+        optimizer.optimizeStep(_weights);
+
+        TElem loss = 0;
+        for(size_t m = 0; m < num_micro; m++) {
+            loss += scales[m] * losses[m];
+        }
+        return loss;
+    }
+
+    template<size_t NumTensors>
+    TElem trainStep(const std::array<NodeShPtr<TElem>, NumTensors>& batch,
+                    Optimizer<TElem>& optimizer)
+    {
+        return trainStep(std::vector<NodeShPtr<TElem>>(batch.begin(), batch.end()), optimizer);
+    }
+};
+
+} // namespace snnl
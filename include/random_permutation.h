@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace snnl
+{
+
+/*
+Pseudo random permutation of [0, size) without an index array. Every key
+defines another permutation, and the element at any position is computed on
+demand in constant time and memory.
+
+The indices are split into two halves of bits, which are mixed by a Feistel
+network. Each round is a bijection, so the network permutes all numbers with
+twice the half bits. Results outside of [0, size) are fed into the network
+again until they are inside (cycle walking). As the network covers less than
+4 * size numbers, this takes less than four rounds on average. e.g.
+
+RandomPermutation permutation(num_samples, seed);
+for(size_t i = 0; i < num_samples; i++) {
+    size_t sample = permutation(i);
+}
+*/
+class RandomPermutation
+{
+    static constexpr size_t NUM_ROUNDS = 4;
+
+    size_t   _size      = 0;
+    size_t   _half_bits = 0;
+    uint64_t _half_mask = 0;
+    uint64_t _keys[NUM_ROUNDS];
+
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    uint64_t feistel(uint64_t x) const
+    {
+        uint64_t left  = x >> _half_bits;
+        uint64_t right = x & _half_mask;
+        for(size_t round = 0; round < NUM_ROUNDS; round++) {
+            uint64_t next = left ^ (mix(right ^ _keys[round]) & _half_mask);
+            left          = right;
+            right         = next;
+        }
+        return (left << _half_bits) | right;
+    }
+
+public:
+    RandomPermutation() { setKey(0); }
+
+    RandomPermutation(size_t size, uint64_t key)
+        : _size(size)
+    {
+        // No position would ever lead into an empty range
+        if(size == 0) {
+            throw std::domain_error("RandomPermutation: Empty range");
+        }
+
+        size_t bits = 0;
+        while(bits < 64 && (uint64_t(1) << bits) < size) {
+            bits++;
+        }
+        _half_bits = (bits + 1) / 2;
+        _half_mask = (uint64_t(1) << _half_bits) - 1;
+        setKey(key);
+    }
+
+    // Choose another permutation of the same size
+    void setKey(uint64_t key)
+    {
+        for(size_t round = 0; round < NUM_ROUNDS; round++) {
+            key          = mix(key + 0x9e3779b97f4a7c15ull);
+            _keys[round] = key;
+        }
+    }
+
+    size_t size() const { return _size; }
+
+    // Element at position of the permutation, position has to be < size()
+    size_t operator()(size_t position) const
+    {
+        uint64_t x = position;
+        do {
+            x = feistel(x);
+        } while(x >= _size);
+        return x;
+    }
+};
+
+} // namespace snnl
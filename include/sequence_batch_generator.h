@@ -0,0 +1,247 @@
+#pragma once
+#include "forward_declare.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace snnl
+{
+
+// Batch of sequences of different lengths, time-major and sorted by
+// decreasing length. The rows still inside their sequence at a step are thus
+// the first numActive(step) ones
+template<typename TElem, size_t NumTensors>
+struct SequenceBatch
+{
+    // Shape {max length, batch size, features...}, zero after the end of a
+    // sequence
+    std::array<Tensor<TElem>, NumTensors> tensors;
+
+    // Shape {max length, batch size, 1}, 1 within a sequence and 0 after it
+    Tensor<TElem> mask;
+
+    std::vector<size_t> lengths;
+
+    size_t batchSize() const { return lengths.size(); }
+
+    size_t maxLength() const { return lengths.empty() ? 0 : lengths[0]; }
+
+    // Number of rows with length > step
+    size_t numActive(size_t step) const
+    {
+        return std::partition_point(lengths.begin(), lengths.end(),
+                                    [&](size_t length) {
+                                        return length > step;
+                                    }) -
+               lengths.begin();
+    }
+
+    // View of the active rows of tensor i at step
+    Tensor<TElem> activeRows(size_t i, size_t step)
+    {
+        Tensor<TElem>& tensor = tensors.at(i);
+
+        Index shape(tensor.NDims() - 1);
+        shape[0] = numActive(step);
+        for(size_t d = 2; d < size_t(tensor.NDims()); d++) {
+            shape[d - 1] = tensor.shape(d);
+        }
+        size_t row_size = tensor.NElems() / (tensor.shape(0) * tensor.shape(1));
+        return tensor.viewOfRange(step * batchSize() * row_size, shape);
+    }
+};
+
+/*
+Draws batches of sequences with as little padding as possible. Every sample is
+made of NumTensors sequences of the same length, stored as tensors of shape
+{length, features...}.
+
+Each pass over the data shuffles the samples and splits them into pools of
+pool_batches batches. The samples of a pool are sorted by length before they
+are cut into batches, so a batch holds sequences of similar length, and the
+order of all batches of the pass is shuffled again. e.g.
+
+SequenceBatchGenerator<float, 2> generator({inputs, targets}, 32);
+auto batch = generator.generateBatch();
+auto outputs = rnn->callSequence(batch.tensors[0], batch.lengths);
+*/
+template<typename TElem, size_t NumTensors>
+class SequenceBatchGenerator
+{
+    std::array<std::vector<Tensor<TElem>>, NumTensors> _sequences;
+    std::vector<size_t>                                _lengths;
+
+    size_t _batch_size;
+    size_t _pool_batches;
+
+    // Samples of the batches of the current pass
+    std::vector<std::vector<size_t>> _batches;
+    size_t                           _current_batch = 0;
+    size_t                           _epoch         = 0;
+    bool                             _mute          = false;
+
+    std::function<void(size_t)> _epoch_callback = [](size_t epoch) {
+        std::cout << "Reaching epoch " + std::to_string(epoch) << std::endl;
+    };
+
+    std::mt19937_64 _rng;
+
+    void reshuffle()
+    {
+        std::vector<size_t> samples(_lengths.size());
+        std::iota(samples.begin(), samples.end(), 0);
+        std::shuffle(samples.begin(), samples.end(), _rng);
+
+        _batches.clear();
+        size_t pool_size = _batch_size * _pool_batches;
+        for(size_t pool_begin = 0; pool_begin < samples.size(); pool_begin += pool_size) {
+            auto begin = samples.begin() + pool_begin;
+            auto end   = samples.begin() + std::min(pool_begin + pool_size, samples.size());
+            std::stable_sort(begin, end, [&](size_t a, size_t b) {
+                return _lengths[a] > _lengths[b];
+            });
+            for(auto batch_begin = begin; batch_begin < end; batch_begin += _batch_size) {
+                auto batch_end = batch_begin + std::min<long>(_batch_size, end - batch_begin);
+                _batches.emplace_back(batch_begin, batch_end);
+            }
+        }
+        std::shuffle(_batches.begin(), _batches.end(), _rng);
+        _current_batch = 0;
+    }
+
+public:
+    SequenceBatchGenerator(const std::array<std::vector<Tensor<TElem>>, NumTensors>& sequences,
+                           size_t batch_size, size_t pool_batches = 16)
+        : _sequences(sequences)
+        , _batch_size(batch_size)
+        , _pool_batches(std::max(pool_batches, size_t(1)))
+        , _rng(time(NULL))
+    {
+        if(batch_size == 0) {
+            throw std::domain_error("SequenceBatchGenerator: Invalid batch size 0");
+        }
+        for(size_t i = 0; i < NumTensors; i++) {
+            if(_sequences[i].size() != _sequences[0].size()) {
+                throw std::domain_error("Dimensions of tensors mismatch");
+            }
+        }
+        if(_sequences[0].empty()) {
+            throw std::domain_error("SequenceBatchGenerator: No samples");
+        }
+
+        for(size_t sample = 0; sample < _sequences[0].size(); sample++) {
+            size_t length = _sequences[0][sample].shape(0);
+            for(size_t i = 0; i < NumTensors; i++) {
+                Tensor<TElem>& sequence = _sequences[i][sample];
+                if(sequence.NDims() < 1 || sequence.shape(0) != length || length == 0) {
+                    throw std::domain_error("SequenceBatchGenerator: Sequences of sample " +
+                                            std::to_string(sample) +
+                                            " are empty or differ in length");
+                }
+                const Tensor<TElem>& first = _sequences[i][0];
+                if(sequence.NDims() != first.NDims() ||
+                   sequence.NElems() / length != first.NElems() / first.shape(0))
+                {
+                    throw std::domain_error("SequenceBatchGenerator: Features of sample " +
+                                            std::to_string(sample) + " differ");
+                }
+                if(!sequence.isContiguous()) {
+                    sequence.shareDataWith(sequence.copy());
+                }
+            }
+            _lengths.push_back(length);
+        }
+
+        reshuffle();
+    }
+
+    size_t numSamples() const { return _lengths.size(); }
+
+    // Number of batches of a pass over the data, the last one of a pool may
+    // be smaller
+    size_t numBatches() const { return _batches.size(); }
+
+    SequenceBatch<TElem, NumTensors> generateBatch()
+    {
+        const std::vector<size_t>& samples = _batches[_current_batch];
+
+        SequenceBatch<TElem, NumTensors> out;
+        for(size_t sample : samples) {
+            out.lengths.push_back(_lengths[sample]);
+        }
+        size_t max_length = out.maxLength();
+        size_t batch_size = samples.size();
+
+        out.mask = Tensor<TElem>({max_length, batch_size, size_t(1)});
+        for(size_t i = 0; i < NumTensors; i++) {
+            Index shape = _sequences[i][0].shape();
+            shape[0]    = batch_size;
+            shape.prependAxis(max_length);
+
+            out.tensors[i] = Tensor<TElem>(shape);
+        }
+
+        parallelFor(0, batch_size, [&](size_t row_begin, size_t row_end) {
+            for(size_t row = row_begin; row < row_end; row++) {
+                size_t length = out.lengths[row];
+                for(size_t step = 0; step < max_length; step++) {
+                    out.mask(step, row, 0) = step < length;
+                }
+
+                for(size_t i = 0; i < NumTensors; i++) {
+                    const Tensor<TElem>& sequence = _sequences[i][samples[row]];
+                    size_t               features = sequence.NElems() / length;
+                    TElem*               target   = out.tensors[i].data() + row * features;
+                    for(size_t step = 0; step < max_length; step++) {
+                        TElem* step_target = target + step * batch_size * features;
+                        if(step < length) {
+                            std::copy_n(sequence.data() + step * features, features, step_target);
+                        }
+                        else {
+                            std::fill_n(step_target, features, TElem(0));
+                        }
+                    }
+                }
+            }
+        });
+
+        _current_batch++;
+        if(_current_batch == _batches.size()) {
+            _epoch++;
+            if(not _mute) {
+                _epoch_callback(_epoch);
+            }
+            reshuffle();
+        }
+        return out;
+    }
+
+    void setEpochCallBack(std::function<void(size_t)> epoch_callback)
+    {
+        _epoch_callback = epoch_callback;
+    }
+
+    void reset()
+    {
+        reshuffle();
+        _epoch = 0;
+    }
+
+    void mute() { _mute = true; }
+
+    void setSeed(size_t seed)
+    {
+        _rng.seed(seed);
+        reset();
+    }
+};
+
+} // namespace snnl
@@ -0,0 +1,550 @@
+#pragma once
+#include "binary_io.h"
+#include "forward_declare.h"
+#include "mapped_file.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <type_traits>
+#include <vector>
+
+namespace snnl
+{
+
+/*
+Data sets split into shards, e.g. written by many jobs in parallel. A shard file
+holds fixed size records, one per sample, each made of the elements of the
+NumTensors tensors of the sample one after another. Its header starts with
+
+char     magic[8]   "SNNLSHRD"
+uint32_t version
+uint32_t type       Type of the elements, with the type codes of IDX files
+uint64_t num_records
+uint32_t num_tensors
+
+followed by the sample shape of every tensor as uint32_t number of dimensions
+and uint64_t per dimension. The records start at the next multiple of
+SHARD_ALIGNMENT. All values are in native byte order.
+
+The index file lists the shards of a data set with their number of records
+under the magic "SNNLSIDX", so that a sample is found without opening every
+shard. Shard paths are relative to the directory of the index file.
+*/
+constexpr uint32_t SHARD_VERSION   = 1;
+constexpr size_t   SHARD_ALIGNMENT = 64;
+
+namespace shard_detail
+{
+
+inline size_t alignedOffset(size_t offset)
+{
+    return (offset + SHARD_ALIGNMENT - 1) / SHARD_ALIGNMENT * SHARD_ALIGNMENT;
+}
+
+inline std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+} // namespace shard_detail
+
+struct ShardHeader
+{
+    uint32_t                         type;
+    uint64_t                         num_records;
+    std::vector<std::vector<size_t>> sample_shapes;
+    size_t                           data_offset;
+};
+
+inline ShardHeader readShardHeader(const MappedFile& file, const std::string& path)
+{
+    BinaryHeaderReader reader(file.data(), file.size(), path);
+    if(reader.readString(8) != "SNNLSHRD") {
+        throw std::runtime_error(path + " is no shard file");
+    }
+    if(uint32_t version = reader.read<uint32_t>(); version != SHARD_VERSION) {
+        throw std::runtime_error("Unsupported shard version " + std::to_string(version) +
+                                 " in " + path);
+    }
+
+    ShardHeader header;
+    header.type        = reader.read<uint32_t>();
+    header.num_records = reader.read<uint64_t>();
+    header.sample_shapes.resize(reader.read<uint32_t>());
+    for(auto& shape : header.sample_shapes) {
+        shape.resize(reader.read<uint32_t>());
+        for(size_t& dim : shape) {
+            dim = reader.read<uint64_t>();
+        }
+    }
+    header.data_offset = shard_detail::alignedOffset(reader.position());
+    return header;
+}
+
+/*
+Writes the samples of one shard. The number of records is filled into the
+header when the shard is closed, e.g.
+
+ShardWriter<uint8_t, 2> writer("train-00003.shard", {{{28, 28}, {1}}});
+writer.write({images, labels});
+writer.close();
+*/
+template<typename TElem, size_t NumTensors>
+class ShardWriter
+{
+    std::string                    _path;
+    std::ofstream                  _file;
+    std::array<size_t, NumTensors> _sample_sizes;
+    uint64_t                       _num_records = 0;
+
+public:
+    ShardWriter(const std::string&                                 path,
+                const std::array<std::vector<size_t>, NumTensors>& sample_shapes)
+        : _path(path)
+        , _file(path, std::ios::binary)
+    {
+        if(!_file) {
+            throw std::runtime_error("ShardWriter: Opening " + path + " failed");
+        }
+
+        _file.write("SNNLSHRD", 8);
+        writeBinaryValue<uint32_t>(_file, SHARD_VERSION);
+        writeBinaryValue<uint32_t>(_file, idxTypeCode<TElem>());
+        writeBinaryValue<uint64_t>(_file, 0);
+        writeBinaryValue<uint32_t>(_file, NumTensors);
+        for(size_t i = 0; i < NumTensors; i++) {
+            writeBinaryValue<uint32_t>(_file, sample_shapes[i].size());
+            _sample_sizes[i] = 1;
+            for(size_t dim : sample_shapes[i]) {
+                writeBinaryValue<uint64_t>(_file, dim);
+                _sample_sizes[i] *= dim;
+            }
+        }
+
+        size_t position = _file.tellp();
+        std::string padding(shard_detail::alignedOffset(position) - position, '\0');
+        _file.write(padding.data(), padding.size());
+    }
+
+    ShardWriter(const ShardWriter&) = delete;
+
+    ~ShardWriter()
+    {
+        if(_file.is_open()) {
+            try {
+                close();
+            }
+            catch(...) {
+            }
+        }
+    }
+
+    uint64_t numRecords() const { return _num_records; }
+
+    // Append one record per row of the tensors. The tensors hold the same
+    // number of samples along their first dimension
+    void write(const std::array<Tensor<TElem>, NumTensors>& samples)
+    {
+        size_t num_samples = samples[0].shape(0);
+        for(size_t i = 0; i < NumTensors; i++) {
+            if(!samples[i].isContiguous() || samples[i].shape(0) != num_samples ||
+               samples[i].NElems() != num_samples * _sample_sizes[i])
+            {
+                throw std::invalid_argument("ShardWriter: Tensor of shape " + samples[i].shape() +
+                                            " does not fit the samples");
+            }
+        }
+
+        // Interleave the tensors into records in memory, then write them at once
+        size_t record_size = 0;
+        for(size_t size : _sample_sizes) {
+            record_size += size;
+        }
+        std::vector<TElem> records(num_samples * record_size);
+        parallelFor(0, num_samples, [&](size_t row_begin, size_t row_end) {
+            for(size_t row = row_begin; row < row_end; row++) {
+                TElem* record = records.data() + row * record_size;
+                for(size_t i = 0; i < NumTensors; i++) {
+                    record = std::copy_n(samples[i].data() + row * _sample_sizes[i],
+                                         _sample_sizes[i], record);
+                }
+            }
+        });
+
+        _file.write(reinterpret_cast<const char*>(records.data()),
+                    records.size() * sizeof(TElem));
+        if(!_file) {
+            throw std::runtime_error("ShardWriter: Writing " + _path + " failed");
+        }
+        _num_records += num_samples;
+    }
+
+    void close()
+    {
+        // Offset of num_records behind magic, version and type
+        _file.seekp(16);
+        writeBinaryValue<uint64_t>(_file, _num_records);
+        _file.close();
+        if(!_file) {
+            throw std::runtime_error("ShardWriter: Writing " + _path + " failed");
+        }
+    }
+};
+
+// Write the index of a data set made of the given shards. The shard headers are
+// checked to fit each other
+inline void writeShardIndex(const std::string& index_path, const std::vector<std::string>& shards)
+{
+    std::string directory = shard_detail::directoryOf(index_path);
+
+    std::vector<uint64_t> num_records;
+    ShardHeader           first;
+    for(size_t s = 0; s < shards.size(); s++) {
+        MappedFile  file(directory + shards[s]);
+        ShardHeader header = readShardHeader(file, shards[s]);
+        if(s == 0) {
+            first = header;
+        }
+        else if(header.type != first.type || header.sample_shapes != first.sample_shapes) {
+            throw std::domain_error("writeShardIndex: Samples of " + shards[s] +
+                                    " differ from the ones of " + shards[0]);
+        }
+        num_records.push_back(header.num_records);
+    }
+
+    std::ofstream file(index_path, std::ios::binary);
+    file.write("SNNLSIDX", 8);
+    writeBinaryValue<uint32_t>(file, SHARD_VERSION);
+    writeBinaryValue<uint32_t>(file, shards.size());
+    for(size_t s = 0; s < shards.size(); s++) {
+        writeBinaryValue<uint64_t>(file, num_records[s]);
+        writeBinaryValue<uint32_t>(file, shards[s].size());
+        file.write(shards[s].data(), shards[s].size());
+    }
+    if(!file) {
+        throw std::runtime_error("writeShardIndex: Writing " + index_path + " failed");
+    }
+}
+
+/*
+Writes a whole data set from a single process. Starts a new shard
+<index_path>-00000.shard, <index_path>-00001.shard, ... every records_per_shard
+samples and writes the index when it is closed.
+*/
+template<typename TElem, size_t NumTensors>
+class ShardedDatasetWriter
+{
+    std::string                                 _index_path;
+    std::array<std::vector<size_t>, NumTensors> _sample_shapes;
+    size_t                                      _records_per_shard;
+
+    std::unique_ptr<ShardWriter<TElem, NumTensors>> _shard;
+    std::vector<std::string>                        _shards;
+
+    void nextShard()
+    {
+        if(_shard) {
+            _shard->close();
+        }
+        std::string directory = shard_detail::directoryOf(_index_path);
+        char        number[32];
+        std::snprintf(number, sizeof(number), "-%05zu.shard", _shards.size());
+
+        std::string name = _index_path.substr(directory.size()) + number;
+        _shard = std::make_unique<ShardWriter<TElem, NumTensors>>(directory + name,
+                                                                  _sample_shapes);
+        _shards.push_back(name);
+    }
+
+public:
+    ShardedDatasetWriter(const std::string&                                 index_path,
+                         const std::array<std::vector<size_t>, NumTensors>& sample_shapes,
+                         size_t                                             records_per_shard)
+        : _index_path(index_path)
+        , _sample_shapes(sample_shapes)
+        , _records_per_shard(records_per_shard)
+    {
+        if(records_per_shard == 0) {
+            throw std::invalid_argument("ShardedDatasetWriter: Invalid number of records 0");
+        }
+    }
+
+    ShardedDatasetWriter(const ShardedDatasetWriter&) = delete;
+
+    ~ShardedDatasetWriter()
+    {
+        if(_shard) {
+            try {
+                close();
+            }
+            catch(...) {
+            }
+        }
+    }
+
+    void write(const std::array<Tensor<TElem>, NumTensors>& samples)
+    {
+        size_t num_samples = samples[0].shape(0);
+        size_t row         = 0;
+        while(row < num_samples) {
+            if(!_shard || _shard->numRecords() == _records_per_shard) {
+                nextShard();
+            }
+            size_t count = std::min(num_samples - row,
+                                    size_t(_records_per_shard - _shard->numRecords()));
+
+            std::array<Tensor<TElem>, NumTensors> part;
+            for(size_t i = 0; i < NumTensors; i++) {
+                Tensor<TElem> source      = samples[i];
+                Index         shape       = source.shape();
+                size_t        sample_size = source.NElems() / num_samples;
+                shape[0]                  = count;
+                part[i] = source.viewOfRange(row * sample_size, shape);
+            }
+            _shard->write(part);
+            row += count;
+        }
+    }
+
+    void close()
+    {
+        if(!_shard) {
+            nextShard();
+        }
+        _shard->close();
+        _shard.reset();
+        writeShardIndex(_index_path, _shards);
+    }
+};
+
+/*
+Reads a data set from its index file. The shards are memory mapped, so only the
+pages of the samples in use are loaded. Samples are numbered across the shards
+in the order of the index, e.g.
+
+ShardedDataset<uint8_t, 2> train("train.index");
+auto [images, labels] = train.load();
+BatchGenerator<float, 2, uint8_t> generator(images, labels);
+
+or without loading everything into memory
+
+auto batch = train.allocateBatch(256);
+for(size_t first = 0; first < train.numSamples(); first += 256) {
+    train.read(first, batch);
+}
+*/
+template<typename TElem, size_t NumTensors>
+class ShardedDataset
+{
+    std::vector<std::unique_ptr<MappedFile>> _files;
+    std::vector<size_t>                      _data_offsets;
+    std::vector<const TElem*>                _records;
+
+    // Number of the first sample of every shard and the total number
+    std::vector<size_t> _shard_begin;
+
+    std::array<std::vector<size_t>, NumTensors> _sample_shapes;
+    std::array<size_t, NumTensors>              _sample_sizes;
+    size_t                                      _record_size = 0;
+
+    // Shard of sample
+    size_t shardOf(size_t sample) const
+    {
+        return std::upper_bound(_shard_begin.begin(), _shard_begin.end(), sample) -
+               _shard_begin.begin() - 1;
+    }
+
+    const TElem* record(size_t sample) const
+    {
+        size_t shard = shardOf(sample);
+        return _records[shard] + (sample - _shard_begin[shard]) * _record_size;
+    }
+
+    void checkBatch(const std::array<Tensor<TElem>, NumTensors>& batch, size_t batch_size) const
+    {
+        for(size_t i = 0; i < NumTensors; i++) {
+            if(batch[i].shape(0) != batch_size || !batch[i].isContiguous() ||
+               batch[i].NElems() != batch_size * _sample_sizes[i])
+            {
+                throw std::invalid_argument("ShardedDataset: Batch tensor of shape " +
+                                            batch[i].shape() + " does not fit the samples");
+            }
+        }
+    }
+
+    void copyRecord(const TElem* source, std::array<Tensor<TElem>, NumTensors>& batch,
+                    size_t row) const
+    {
+        for(size_t i = 0; i < NumTensors; i++) {
+            std::copy_n(source, _sample_sizes[i], batch[i].data() + row * _sample_sizes[i]);
+            source += _sample_sizes[i];
+        }
+    }
+
+public:
+    explicit ShardedDataset(const std::string& index_path)
+    {
+        MappedFile index(index_path);
+
+        BinaryHeaderReader reader(index.data(), index.size(), index_path);
+        if(reader.readString(8) != "SNNLSIDX") {
+            throw std::runtime_error(index_path + " is no shard index");
+        }
+        if(uint32_t version = reader.read<uint32_t>(); version != SHARD_VERSION) {
+            throw std::runtime_error("Unsupported index version " + std::to_string(version) +
+                                     " in " + index_path);
+        }
+
+        size_t      num_shards = reader.read<uint32_t>();
+        std::string directory  = shard_detail::directoryOf(index_path);
+        _shard_begin.push_back(0);
+
+        for(size_t s = 0; s < num_shards; s++) {
+            uint64_t    num_records = reader.read<uint64_t>();
+            std::string path        = directory + reader.readString(reader.read<uint32_t>());
+
+            _files.push_back(std::make_unique<MappedFile>(path));
+            ShardHeader header = readShardHeader(*_files.back(), path);
+
+            if(header.type != idxTypeCode<TElem>()) {
+                throw std::domain_error("ShardedDataset: Element type of " + path +
+                                        " does not match");
+            }
+            if(header.sample_shapes.size() != NumTensors) {
+                throw std::domain_error("ShardedDataset: " + path + " holds " +
+                                        std::to_string(header.sample_shapes.size()) +
+                                        " tensors per sample");
+            }
+            if(s == 0) {
+                for(size_t i = 0; i < NumTensors; i++) {
+                    _sample_shapes[i] = header.sample_shapes[i];
+                    _sample_sizes[i]  = 1;
+                    for(size_t dim : _sample_shapes[i]) {
+                        _sample_sizes[i] *= dim;
+                    }
+                    _record_size += _sample_sizes[i];
+                }
+            }
+            else if(!std::equal(_sample_shapes.begin(), _sample_shapes.end(),
+                                header.sample_shapes.begin()))
+            {
+                throw std::domain_error("ShardedDataset: Samples of " + path +
+                                        " differ from the ones of the first shard");
+            }
+            if(header.num_records != num_records ||
+               _files.back()->size() != header.data_offset +
+                                            num_records * _record_size * sizeof(TElem))
+            {
+                throw std::runtime_error("ShardedDataset: Size of " + path +
+                                         " does not match the index");
+            }
+
+            _data_offsets.push_back(header.data_offset);
+            _records.push_back(
+                reinterpret_cast<const TElem*>(_files.back()->data() + header.data_offset));
+            _shard_begin.push_back(_shard_begin.back() + num_records);
+        }
+    }
+
+    size_t numSamples() const { return _shard_begin.back(); }
+
+    size_t numShards() const { return _files.size(); }
+
+    const std::vector<size_t>& sampleShape(size_t i) const { return _sample_shapes.at(i); }
+
+    // Tensors holding batch_size samples
+    std::array<Tensor<TElem>, NumTensors> allocateBatch(size_t batch_size) const
+    {
+        std::array<Tensor<TElem>, NumTensors> out;
+
+        for(size_t i = 0; i < NumTensors; i++) {
+            Index shape_out(_sample_shapes[i].size() + 1);
+            shape_out[0] = batch_size;
+            for(size_t d = 0; d < _sample_shapes[i].size(); d++) {
+                shape_out[d + 1] = _sample_shapes[i][d];
+            }
+            out[i] = Tensor<TElem>(shape_out);
+        }
+        return out;
+    }
+
+    // Copy the samples with the given numbers into the rows of batch. The
+    // records are read in parallel
+    void gather(const std::vector<size_t>& indices,
+                std::array<Tensor<TElem>, NumTensors>& batch) const
+    {
+        checkBatch(batch, indices.size());
+        for(size_t sample : indices) {
+            if(sample >= numSamples()) {
+                throw std::out_of_range("ShardedDataset: Sample " + std::to_string(sample) +
+                                        " out of range");
+            }
+        }
+
+        parallelFor(0, indices.size(), [&](size_t row_begin, size_t row_end) {
+            for(size_t row = row_begin; row < row_end; row++) {
+                copyRecord(record(indices[row]), batch, row);
+            }
+        });
+    }
+
+    // Copy the consecutive samples first, first + 1, ... into batch, which may
+    // span several shards. The samples following them are read ahead
+    void read(size_t first, std::array<Tensor<TElem>, NumTensors>& batch) const
+    {
+        size_t batch_size = batch[0].shape(0);
+        checkBatch(batch, batch_size);
+        if(first + batch_size > numSamples()) {
+            throw std::out_of_range("ShardedDataset: Samples up to " +
+                                    std::to_string(first + batch_size) + " out of range");
+        }
+
+        parallelFor(0, batch_size, [&](size_t row_begin, size_t row_end) {
+            // Records of a shard are consecutive
+            size_t row = row_begin;
+            while(row < row_end) {
+                size_t sample = first + row;
+                size_t shard  = shardOf(sample);
+                size_t count  = std::min(row_end - row, _shard_begin[shard + 1] - sample);
+
+                const TElem* source = record(sample);
+                for(size_t r = row; r < row + count; r++) {
+                    copyRecord(source, batch, r);
+                    source += _record_size;
+                }
+                row += count;
+            }
+        });
+
+        size_t ahead_begin = first + batch_size;
+        size_t ahead_end   = std::min(ahead_begin + batch_size, numSamples());
+        while(ahead_begin < ahead_end) {
+            size_t shard = shardOf(ahead_begin);
+            size_t end   = std::min(ahead_end, _shard_begin[shard + 1]);
+            size_t bytes = _record_size * sizeof(TElem);
+            size_t begin = _data_offsets[shard] + (ahead_begin - _shard_begin[shard]) * bytes;
+            _files[shard]->advise(begin, begin + (end - ahead_begin) * bytes, MADV_WILLNEED);
+            ahead_begin = end;
+        }
+    }
+
+    // All samples of the data set, e.g. for a BatchGenerator
+    std::array<Tensor<TElem>, NumTensors> load() const
+    {
+        auto out = allocateBatch(numSamples());
+        read(0, out);
+        return out;
+    }
+};
+
+} // namespace snnl
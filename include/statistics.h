@@ -1,6 +1,11 @@
 #pragma once
 #include "forward_declare.h"
 #include "tensor.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace snnl
 {
@@ -28,4 +33,100 @@ double sparseAccuracy(const NodeShPtr<TElem>& encodings, const Tensor<TElem>& la
     return sparseAccuracy(encodings->values(), labels);
 }
 
+/*
+Metrics of a classifier, accumulated over batches of encodings, i.e. class
+probabilities of shape {batch, classes}, and sparse labels. Partial metrics,
+e.g. of several threads, are combined with merge. Besides the accuracy, it
+counts the samples whose label is among the top_k most probable classes, the
+mean sparse categorical cross entropy and the confusion matrix
+*/
+template<typename TElem>
+class ClassificationMetrics
+{
+    size_t _num_classes;
+    size_t _top_k;
+
+    size_t _num_samples = 0;
+    size_t _num_correct = 0;
+    size_t _num_top_k   = 0;
+    double _loss_sum    = 0;
+
+    // Row of the label, column of the prediction
+    std::vector<size_t> _confusion;
+
+public:
+    explicit ClassificationMetrics(size_t num_classes, size_t top_k = 5)
+        : _num_classes(num_classes)
+        , _top_k(top_k)
+        , _confusion(num_classes * num_classes, 0)
+    {}
+
+    void update(const Tensor<TElem>& encodings, const Tensor<TElem>& labels)
+    {
+        auto probabilities = encodings.viewWithNDimsOnTheRight(2);
+        auto label_view    = labels.flatten();
+        if(probabilities.shape(-1) != _num_classes ||
+           probabilities.shape(0) != label_view.shape(0))
+        {
+            throw std::invalid_argument("ClassificationMetrics: Encodings of shape " +
+                                        encodings.shape() + " do not fit " +
+                                        std::to_string(_num_classes) + " classes and labels " +
+                                        labels.shape());
+        }
+
+        for(size_t i = 0; i < label_view.shape(0); i++) {
+            size_t label = label_view(i);
+            if(label >= _num_classes) {
+                throw std::out_of_range("ClassificationMetrics: Label " + std::to_string(label) +
+                                        " out of range");
+            }
+            TElem  label_probability = probabilities(i, label);
+            size_t prediction        = 0;
+            size_t num_above         = 0;
+            for(size_t c = 0; c < _num_classes; c++) {
+                if(probabilities(i, c) > probabilities(i, prediction)) {
+                    prediction = c;
+                }
+                num_above += probabilities(i, c) > label_probability;
+            }
+
+            _num_correct += prediction == label;
+            _num_top_k += num_above < _top_k;
+            _loss_sum -= std::log(label_probability + std::numeric_limits<TElem>::min());
+            _confusion[label * _num_classes + prediction]++;
+        }
+        _num_samples += label_view.shape(0);
+    }
+
+    void merge(const ClassificationMetrics& other)
+    {
+        if(other._num_classes != _num_classes || other._top_k != _top_k) {
+            throw std::invalid_argument("ClassificationMetrics: Cannot merge different metrics");
+        }
+        _num_samples += other._num_samples;
+        _num_correct += other._num_correct;
+        _num_top_k += other._num_top_k;
+        _loss_sum += other._loss_sum;
+        for(size_t i = 0; i < _confusion.size(); i++) {
+            _confusion[i] += other._confusion[i];
+        }
+    }
+
+    size_t numSamples() const { return _num_samples; }
+
+    size_t numClasses() const { return _num_classes; }
+
+    double accuracy() const { return double(_num_correct) / _num_samples; }
+
+    double topKAccuracy() const { return double(_num_top_k) / _num_samples; }
+
+    double meanLoss() const { return _loss_sum / _num_samples; }
+
+    // Number of samples with the given label classified as prediction
+    size_t confusion(size_t label, size_t prediction) const
+    {
+        return _confusion.at(label * _num_classes + prediction);
+    }
+};
+
 } // namespace snnl
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include "index.h"
+#include "thread_pool.h"
 #include "tools.h"
 #include <array>
 #include <cstddef>
@@ -93,7 +94,16 @@ class Tensor
         checkResizeAllowed(shape);
 
         _mem_offset = 0;
-        _NDims      = shape.size();
+        setShape(shape);
+
+        fillStrides();
+    }
+
+    // Only sets the shape. Strides and data are left untouched
+    template<typename TArray>
+    void setShape(const TArray& shape)
+    {
+        _NDims = shape.size();
         _shape.setNDims(shape.size());
 
         int i = 0;
@@ -101,8 +111,6 @@ class Tensor
             _shape[i] = dim_len;
             i++;
         }
-
-        fillStrides();
     }
 
     template<typename TArray>
@@ -409,7 +417,12 @@ public:
             _index = _ptr->index(_position);
             return *this;
         }
-        bool operator!=(const Iterator& other) { return _index != other._index; }
+        // The position along the first axis tells apart elements of
+        // overlapping rows, e.g. of slidingWindows, which share their index
+        bool operator!=(const Iterator& other)
+        {
+            return _index != other._index || _position[0] != other._position[0];
+        }
 
         TElem& operator*() { return _ptr->_data->at(_index); }
 
@@ -588,10 +601,8 @@ public:
 
     size_t NElems() const
     {
-        if(_NDims == 0) {
-            return 1;
-        }
-        return _strides[0] * _shape[0];
+        return std::accumulate(_shape.begin(), _shape.end(), size_t(1),
+                               std::multiplies<size_t>());
     }
 
     template<typename... T>
@@ -698,10 +709,16 @@ public:
     template<typename TArray>
     Tensor<TElem> viewAs(const TArray& arr)
     {
+        if(NElemsFromShape(arr) != NElems() || !isContiguous()) {
+            throw std::domain_error("View of tensor does not evenly fit into source tensor");
+        }
+
         Tensor out;
         out._data = _data;
-
-        out.setDims(arr);
+        out.setShape(arr);
+        out.fillStrides(false);
+        out._mem_offset      = _mem_offset;
+        out._is_partial_view = _is_partial_view;
 
         auto itbegin = _strides.begin();
 
@@ -724,6 +741,118 @@ public:
         return const_cast<Tensor<TElem>*>(this)->viewAs(arr);
     }
 
+    // View of the consecutive elements [offset, offset + NElems(shape)) of a
+    // contiguous tensor in the given shape, e.g. of a part of a flat buffer
+    template<typename TArray>
+    Tensor<TElem> viewOfRange(size_t offset, const TArray& shape)
+    {
+        if(!isContiguous() || offset + NElemsFromShape(shape) > NElems()) {
+            throw std::domain_error("Range does not fit into source tensor");
+        }
+
+        Tensor out;
+        out._data = _data;
+        out.setShape(shape);
+        out.fillStrides(false);
+        out._mem_offset      = _mem_offset + offset;
+        out._is_partial_view = out.NElems() != _data->size();
+        return out;
+    }
+
+    /*
+    View of the windows of window consecutive rows along the first axis,
+    starting every hop rows, in the shape {number of windows, window, ...}.
+    The windows overlap for hop < window. No element is copied, all windows
+    share the memory of this tensor, e.g. for a time series of shape
+    {steps, features}
+
+    Tensor<float> windows = series.slidingWindows(64, 8);
+
+    Writing to an element changes it in every window holding it
+    */
+    Tensor<TElem> slidingWindows(size_t window, size_t hop) const
+    {
+        if(_NDims == 0 || window == 0 || hop == 0 || window > _shape[0]) {
+            throw std::invalid_argument("slidingWindows: Invalid window " +
+                                        std::to_string(window) + " with hop " +
+                                        std::to_string(hop) + " for tensor " + shape());
+        }
+
+        Tensor out;
+        out._data            = _data;
+        out._NDims           = _NDims + 1;
+        out._shape           = _shape;
+        out._strides         = _strides;
+        out._mem_offset      = _mem_offset;
+        out._is_partial_view = true;
+
+        out._shape[0] = window;
+        out._shape.prependAxis((_shape[0] - window) / hop + 1);
+        out._strides.prependAxis(hop * _strides[0]);
+        return out;
+    }
+
+    // True if each row, i.e. each index along the first axis, is one block of
+    // consecutive elements. Unlike isContiguous, this holds for
+    // slidingWindows and strided ranges of rows
+    bool rowsContiguous() const
+    {
+        size_t expected_stride = 1;
+        for(long i = _NDims - 1; i >= 1; i--) {
+            if(_shape[i] != 1 && _strides[i] != expected_stride) {
+                return false;
+            }
+            expected_stride *= _shape[i];
+        }
+        return true;
+    }
+
+    /*
+    Copy the rows with the given indices along the first axis into out, e.g. to
+    assemble a batch from a data set. out needs the shape of this tensor with
+    indices.size() rows. If the rows of both tensors are contiguous, every row
+    is copied as one block and the rows are split among the threads
+    */
+    void gatherRows(const std::vector<size_t>& indices, Tensor<TElem>& out) const
+    {
+        if(_NDims == 0 || out._NDims != _NDims || out.shape(0) != indices.size() ||
+           !std::equal(_shape.begin() + 1, _shape.end(), out.shape().begin() + 1))
+        {
+            throw std::invalid_argument("gatherRows: Cannot gather " +
+                                        std::to_string(indices.size()) + " rows of tensor " +
+                                        shape() + " into tensor " + out.shape());
+        }
+        for(size_t index : indices) {
+            if(index >= _shape[0]) {
+                throw std::out_of_range("gatherRows: Row " + std::to_string(index) +
+                                        " out of range for tensor " + shape());
+            }
+        }
+
+        if(!rowsContiguous() || !out.isContiguous()) {
+            for(size_t row = 0; row < indices.size(); row++) {
+                out.viewAs(row, ellipsis()) =
+                    const_cast<Tensor<TElem>*>(this)->viewAs(indices[row], ellipsis());
+            }
+            return;
+        }
+
+        size_t       row_size   = indices.empty() ? 0 : out.NElems() / indices.size();
+        size_t       row_stride = _strides[0];
+        const TElem* source     = data();
+        TElem*       target     = out.data();
+
+        parallelFor(
+            0, indices.size(),
+            [&](size_t row_begin, size_t row_end) {
+                for(size_t row = row_begin; row < row_end; row++) {
+                    std::copy_n(source + indices[row] * row_stride, row_size,
+                                target + row * row_size);
+                }
+            },
+            PARALLEL_GRAIN_SIZE / std::max(row_size, size_t(1)));
+    }
+
     Tensor<TElem> viewFromIndices(std::initializer_list<long> list)
     {
         return viewFromIndices(std::vector<long>(list.begin(), list.end()));
@@ -975,6 +1104,38 @@ public:
 
     std::vector<TElem>& rawData() { return *_data; }
 
+    // True if the elements lie consecutively in memory without gaps, i.e. for
+    // all tensors which are no partial views and for ranges along the first axis
+    bool isContiguous() const
+    {
+        size_t expected_stride = 1;
+        for(long i = _NDims - 1; i >= 0; i--) {
+            if(_shape[i] != 1 && _strides[i] != expected_stride) {
+                return false;
+            }
+            expected_stride *= _shape[i];
+        }
+        return true;
+    }
+
+    // Pointer to the first element. Only meaningful for contiguous tensors,
+    // i.e. no partial views
+    TElem* data() { return _data->data() + _mem_offset; }
+
+    const TElem* data() const { return _data->data() + _mem_offset; }
+
+    // Use the memory of other instead of the own one. Changes to the values of
+    // either tensor are visible in both
+    void shareDataWith(const Tensor& other)
+    {
+        _NDims           = other._NDims;
+        _shape           = other._shape;
+        _strides         = other._strides;
+        _mem_offset      = other._mem_offset;
+        _is_partial_view = other._is_partial_view;
+        _data            = other._data;
+    }
+
     /*Elementwise modification in place using operation defined by op. If
     other.NDims() is smaller than NDims(), broadcasting
     takes place. Otherwise the dimension has to match exactly*/
@@ -1219,7 +1380,7 @@ public:
 
     std::vector<uint8_t> toByteArray() const
     {
-        if(_is_partial_view) {
+        if(!isContiguous()) {
             throw std::invalid_argument("Cannot save views");
         }
         std::vector<uint8_t> out;
@@ -1227,11 +1388,8 @@ public:
 
         out.insert(out.end(), shape.begin(), shape.end());
 
-        uint8_t* ptr = reinterpret_cast<uint8_t*>(&(*_data)[0]);
-
-        for(size_t i = 0; i < _data->size() * sizeof(TElem); i++) {
-            out.push_back(ptr[i]);
-        }
+        const uint8_t* ptr = reinterpret_cast<const uint8_t*>(_data->data() + _mem_offset);
+        out.insert(out.end(), ptr, ptr + NElems() * sizeof(TElem));
 
         return out;
     }
@@ -0,0 +1,391 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace snnl
+{
+
+// Minimal number of elements per chunk for cheap element wise loops. Below, the
+// synchronization overhead outweighs the gain of parallel execution
+const size_t PARALLEL_GRAIN_SIZE = 4096;
+
+class ThreadPool
+{
+    // Every worker owns a deque. It pushes and pops its own tasks at the back
+    // and steals from the front of the other deques if it runs dry
+    struct WorkerQueue
+    {
+        std::mutex                        mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread>                  _workers;
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::atomic<size_t>                       _pending    = 0;
+    std::atomic<size_t>                       _next_queue = 0;
+    std::mutex                                _mutex;
+    std::condition_variable                   _condition;
+    bool                                      _stop = false;
+
+    // True while the current thread executes a chunk of a parallel loop. Nested
+    // loops are then executed inline to avoid oversubscription
+    static bool& inParallelRegion()
+    {
+        static thread_local bool in_region = false;
+        return in_region;
+    }
+
+    // Pool and queue index of the current thread, if it is a worker
+    static ThreadPool*& currentPool()
+    {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static size_t& currentQueue()
+    {
+        static thread_local size_t queue = 0;
+        return queue;
+    }
+
+    bool popTask(std::function<void()>& task)
+    {
+        size_t num_queues = _queues.size();
+        size_t own_queue  = num_queues;
+        size_t first      = _next_queue % std::max(num_queues, size_t(1));
+
+        if(currentPool() == this) {
+            own_queue = currentQueue();
+            first     = own_queue + 1;
+
+            WorkerQueue&                queue = *_queues[own_queue];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(!queue.tasks.empty()) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for(size_t i = 0; i < num_queues; i++) {
+            size_t victim = (first + i) % num_queues;
+            if(victim == own_queue) {
+                continue;
+            }
+            WorkerQueue&                queue = *_queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void notify()
+    {
+        {
+            // Taking the lock avoids a lost wake up of a worker that is just
+            // about to sleep
+            std::lock_guard<std::mutex> lock(_mutex);
+        }
+        _condition.notify_all();
+    }
+
+    void workerLoop(size_t index)
+    {
+        currentPool()  = this;
+        currentQueue() = index;
+        while(true) {
+            if(runPendingTask()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this] {
+                return _stop || _pending > 0;
+            });
+            if(_stop && _pending == 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    // num_threads counts the calling thread, which takes part in every parallel
+    // loop. Hence only num_threads - 1 workers are spawned
+    explicit ThreadPool(size_t num_threads)
+    {
+        num_threads = std::max(num_threads, size_t(1));
+        for(size_t i = 1; i < num_threads; i++) {
+            _queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for(size_t i = 0; i < _queues.size(); i++) {
+            _workers.emplace_back([this, i] {
+                workerLoop(i);
+            });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _condition.notify_all();
+        for(auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    size_t numThreads() const { return _workers.size() + 1; }
+
+    // Runs all parallel loops of the current thread inline while in scope. Used
+    // while holding locks, since waiting for a loop may pick up other tasks
+    // that need the same locks
+    class SerialScope
+    {
+        bool _was_in_region;
+
+    public:
+        SerialScope()
+            : _was_in_region(inParallelRegion())
+        {
+            inParallelRegion() = true;
+        }
+
+        SerialScope(const SerialScope&) = delete;
+
+        ~SerialScope() { inParallelRegion() = _was_in_region; }
+    };
+
+    // Queue a task. Tasks submitted from a worker go to its own deque, others
+    // are distributed round robin. Without workers, the task runs immediately
+    void submit(std::function<void()> task)
+    {
+        if(_queues.empty()) {
+            task();
+            return;
+        }
+        size_t queue_index =
+            currentPool() == this ? currentQueue() : _next_queue++ % _queues.size();
+        {
+            WorkerQueue&                queue = *_queues[queue_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        _pending++;
+        notify();
+    }
+
+    // Run one queued task on the calling thread. Returns false if there was none
+    bool runPendingTask()
+    {
+        std::function<void()> task;
+        if(!popTask(task)) {
+            return false;
+        }
+        _pending--;
+        task();
+        return true;
+    }
+
+    // Help with queued tasks until done() returns true. Waiting threads never
+    // idle while there is work, so blocking inside a task cannot deadlock the
+    // pool
+    template<typename Predicate>
+    void waitUntil(Predicate&& done)
+    {
+        while(!done()) {
+            if(runPendingTask()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait_for(lock, std::chrono::microseconds(100), [&] {
+                return _pending > 0 || done();
+            });
+        }
+    }
+
+    // Wake up threads blocked in waitUntil to re-check their condition
+    void notifyWaiting() { notify(); }
+
+    // Split [begin, end) into at most numThreads() chunks of at least
+    // grain_size elements and call func(chunk_begin, chunk_end) for each of
+    // them. Returns after all chunks are done. The first exception thrown by
+    // func is rethrown on the calling thread
+    template<typename Func>
+    void parallelFor(size_t begin, size_t end, Func&& func, size_t grain_size = 1)
+    {
+        if(end <= begin) {
+            return;
+        }
+        size_t range      = end - begin;
+        grain_size        = std::max(grain_size, size_t(1));
+        size_t num_chunks = std::min(numThreads(), (range + grain_size - 1) / grain_size);
+
+        if(num_chunks <= 1 || inParallelRegion()) {
+            func(begin, end);
+            return;
+        }
+
+        std::atomic<size_t> remaining = num_chunks;
+        std::mutex          error_mutex;
+        std::exception_ptr  error;
+
+        auto run_chunk = [&](size_t chunk) {
+            size_t chunk_begin = begin + range * chunk / num_chunks;
+            size_t chunk_end   = begin + range * (chunk + 1) / num_chunks;
+
+            bool was_in_region = inParallelRegion();
+            inParallelRegion() = true;
+            try {
+                func(chunk_begin, chunk_end);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+            }
+            inParallelRegion() = was_in_region;
+
+            // The caller may return as soon as remaining drops to zero, so do
+            // not touch the captures afterwards
+            ThreadPool* pool = this;
+            if(--remaining == 0) {
+                pool->notify();
+            }
+        };
+
+        for(size_t chunk = 1; chunk < num_chunks; chunk++) {
+            submit([&run_chunk, chunk] {
+                run_chunk(chunk);
+            });
+        }
+        run_chunk(0);
+
+        waitUntil([&] {
+            return remaining == 0;
+        });
+
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Map each chunk of [begin, end) to a partial result via
+    // map(chunk_begin, chunk_end) and combine them from left to right with
+    // reduce(accumulated, partial), starting with init
+    template<typename TResult, typename Map, typename Reduce>
+    TResult parallelReduce(size_t begin, size_t end, TResult init, Map&& map, Reduce&& reduce,
+                           size_t grain_size = 1)
+    {
+        if(end <= begin) {
+            return init;
+        }
+        size_t range      = end - begin;
+        grain_size        = std::max(grain_size, size_t(1));
+        size_t num_chunks = std::min(numThreads(), (range + grain_size - 1) / grain_size);
+
+        if(num_chunks <= 1 || inParallelRegion()) {
+            return reduce(std::move(init), map(begin, end));
+        }
+
+        std::vector<std::unique_ptr<TResult>> partials(num_chunks);
+
+        parallelFor(0, num_chunks, [&](size_t chunk_begin, size_t chunk_end) {
+            for(size_t chunk = chunk_begin; chunk < chunk_end; chunk++) {
+                size_t sub_begin = begin + range * chunk / num_chunks;
+                size_t sub_end   = begin + range * (chunk + 1) / num_chunks;
+                partials[chunk]  = std::make_unique<TResult>(map(sub_begin, sub_end));
+            }
+        });
+
+        for(auto& partial : partials) {
+            init = reduce(std::move(init), std::move(*partial));
+        }
+        return init;
+    }
+};
+
+inline size_t defaultNumThreads()
+{
+    if(const char* env = std::getenv("SNNL_NUM_THREADS")) {
+        long num_threads = std::atol(env);
+        if(num_threads > 0) {
+            return num_threads;
+        }
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+inline std::unique_ptr<ThreadPool>& globalThreadPoolPtr()
+{
+    static std::unique_ptr<ThreadPool> pool;
+    return pool;
+}
+
+inline std::mutex& globalThreadPoolMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Pool used by all connectors and optimizers. Created on first use with
+// SNNL_NUM_THREADS threads or, if unset, one thread per hardware thread
+inline ThreadPool& globalThreadPool()
+{
+    std::lock_guard<std::mutex> lock(globalThreadPoolMutex());
+    auto&                       pool = globalThreadPoolPtr();
+    if(!pool) {
+        pool = std::make_unique<ThreadPool>(defaultNumThreads());
+    }
+    return *pool;
+}
+
+// Must not be called while parallel work is running
+inline void setNumThreads(size_t num_threads)
+{
+    std::lock_guard<std::mutex> lock(globalThreadPoolMutex());
+    auto&                       pool = globalThreadPoolPtr();
+    pool.reset();
+    pool = std::make_unique<ThreadPool>(num_threads);
+}
+
+inline size_t numThreads()
+{
+    return globalThreadPool().numThreads();
+}
+
+template<typename Func>
+void parallelFor(size_t begin, size_t end, Func&& func, size_t grain_size = 1)
+{
+    globalThreadPool().parallelFor(begin, end, std::forward<Func>(func), grain_size);
+}
+
+template<typename TResult, typename Map, typename Reduce>
+TResult parallelReduce(size_t begin, size_t end, TResult init, Map&& map, Reduce&& reduce,
+                       size_t grain_size = 1)
+{
+    return globalThreadPool().parallelReduce(begin, end, std::move(init), std::forward<Map>(map),
+                                             std::forward<Reduce>(reduce), grain_size);
+}
+
+} // namespace snnl
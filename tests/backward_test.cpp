@@ -1,9 +1,11 @@
 #include "common_connectors.h"
 #include "connectors/connector_concatenate.h"
 #include "forward_declare.h"
+#include "graph_executor.h"
 #include "module.h"
 #include "modules/module_conv2d.h"
 #include "modules/module_dense.h"
+#include "modules/module_simpleRNN.h"
 #include "node.h"
 #include <cmath>
 #include <gtest/gtest-param-test.h>
@@ -688,6 +690,191 @@ TEST(ImageTest, UNet)
     test_grad(model, {image, labels}, 5e-2);
 }
 
+void compareGradients(const std::vector<Tensor<double>>& expected,
+                      const std::vector<NodeShPtr<double>>& nodes)
+{
+    ASSERT_EQ(expected.size(), nodes.size());
+    for(size_t i = 0; i < nodes.size(); i++) {
+        auto it = expected[i].begin();
+        for(double val : nodes[i]->gradient()) {
+            EXPECT_NEAR(val, *it, 1e-12);
+            ++it;
+        }
+    }
+}
+
+TEST(GraphExecutorTest, Branches)
+{
+    struct BranchModel : public Module<double>
+    {
+        DenseModuleShPtr<double> left;
+        DenseModuleShPtr<double> right;
+        DenseModuleShPtr<double> head_1;
+        DenseModuleShPtr<double> head_2;
+
+        BranchModel()
+        {
+            left   = addModule<DenseModule>(4, 6);
+            right  = addModule<DenseModule>(4, 6);
+            head_1 = addModule<DenseModule>(12, 3);
+            head_2 = addModule<DenseModule>(6, 3);
+        }
+
+        virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+        {
+            auto& x      = inputs.at(0);
+            auto& target = inputs.at(1);
+
+            auto a = Sigmoid(left->call(x));
+            auto b = Sigmoid(right->call(x));
+
+            auto out_1 = head_1->call(Concatenate(a, b));
+            auto out_2 = head_2->call(Add(a, b));
+
+            return Add(MSE(out_1, target), MSE(out_2, target));
+        }
+    };
+
+    BranchModel       model;
+    NodeShPtr<double> x      = Node<double>::create({5, 4});
+    NodeShPtr<double> target = Node<double>::create({5, 3});
+    x->values().uniform();
+    target->values().uniform();
+
+    std::vector<NodeShPtr<double>> nodes(model.weights().begin(), model.weights().end());
+    nodes.push_back(x);
+
+    auto loss = model.call(x, target);
+    loss->computeGrad();
+
+    std::vector<Tensor<double>> expected;
+    for(auto& node : nodes) {
+        expected.push_back(node->gradient().copy());
+    }
+
+    GraphExecutor<double> executor(loss);
+
+    for(size_t num_threads : {1, 4}) {
+        setNumThreads(num_threads);
+
+        for(auto& node : nodes) {
+            node->gradient().setAllValues(42);
+        }
+        executor.backward();
+        compareGradients(expected, nodes);
+    }
+
+    x->values().uniform();
+    executor.forward();
+    EXPECT_NEAR(loss->value(0), model.call(x, target)->value(0), 1e-12);
+}
+
+TEST(GraphExecutorTest, SharedWeights)
+{
+    setNumThreads(4);
+
+    auto rnn = Module<double>::create<SimpleRNNModule>(3, 5);
+    rnn->W_h()->values().uniform();
+
+    NodeShPtr<double> x = Node<double>::create({4, 3});
+    x->values().uniform();
+
+    NodeShPtr<double> h;
+    for(size_t step = 0; step < 6; step++) {
+        h = rnn->call(x);
+    }
+    auto loss = Sum(Mult(h, h));
+    loss->computeGrad();
+
+    std::vector<NodeShPtr<double>> nodes(rnn->weights().begin(), rnn->weights().end());
+    nodes.push_back(x);
+
+    std::vector<Tensor<double>> expected;
+    for(auto& node : nodes) {
+        expected.push_back(node->gradient().copy());
+    }
+
+    GraphExecutor<double> executor(loss);
+    for(size_t repeat = 0; repeat < 10; repeat++) {
+        executor.backward();
+        compareGradients(expected, nodes);
+    }
+}
+
+TEST(SimpleRNNTest, CallSequenceSkipsPadding)
+{
+    auto rnn = Module<double>::create<SimpleRNNModule>(3, 4);
+    rnn->W_h()->values().uniform();
+    rnn->B()->values().uniform();
+
+    std::vector<size_t> lengths = {5, 3, 3, 1};
+    Tensor<double>      inputs({5, 4, 3});
+    inputs.uniform();
+
+    auto outputs = rnn->callSequence(inputs, lengths);
+    ASSERT_EQ(outputs.size(), 5);
+    EXPECT_EQ(outputs[0]->shape(), Index({4, 4}));
+    EXPECT_EQ(outputs[2]->shape(), Index({3, 4}));
+    EXPECT_EQ(outputs[4]->shape(), Index({1, 4}));
+
+    NodeShPtr<double> loss = Sum(Mult(outputs[0], outputs[0]));
+    for(size_t step = 1; step < outputs.size(); step++) {
+        loss = Add(loss, Sum(Mult(outputs[step], outputs[step])));
+    }
+    loss->computeGrad();
+
+    std::vector<NodeShPtr<double>> weights(rnn->weights().begin(), rnn->weights().end());
+    std::vector<Tensor<double>>    expected;
+    for(auto& weight : weights) {
+        expected.push_back(weight->gradient().copy());
+    }
+
+    // All rows at every step with the padding masked out. The state is
+    // passed as a copy, which keeps the graph of every step
+    rnn->hPrev() = Node<double>::create({size_t(4)});
+    rnn->hPrev()->setAllValues(0);
+
+    NodeShPtr<double> reference_loss;
+    for(size_t step = 0; step < 5; step++) {
+        Tensor<double>    x = inputs.viewOfRange(step * 12, std::vector<size_t>{4, 3});
+        NodeShPtr<double> h = rnn->call(Node<double>::create(x));
+        rnn->hPrev()        = Node<double>::create(h->values());
+
+        NodeShPtr<double> mask = Node<double>::create({4, 4});
+        for(size_t row = 0; row < 4; row++) {
+            for(size_t unit = 0; unit < 4; unit++) {
+                mask->value(row, unit) = step < lengths[row];
+                if(step < lengths[row]) {
+                    EXPECT_NEAR(outputs[step]->value(row, unit), h->value(row, unit), 1e-12);
+                }
+            }
+        }
+
+        NodeShPtr<double> masked = Mult(h, mask);
+        NodeShPtr<double> term   = Sum(Mult(masked, masked));
+        reference_loss           = reference_loss ? Add(reference_loss, term) : term;
+    }
+    EXPECT_NEAR(reference_loss->value(0), loss->value(0), 1e-12);
+
+    reference_loss->computeGrad();
+    compareGradients(expected, weights);
+
+    EXPECT_THROW(rnn->callSequence(inputs, {3, 5, 1, 1}), std::invalid_argument);
+    EXPECT_THROW(rnn->callSequence(inputs, {6, 3, 1, 1}), std::invalid_argument);
+
+    // Plain calls of any batch size start from a zero state afterwards
+    rnn->callSequence(inputs, lengths);
+    NodeShPtr<double> x = Node<double>::create({2, 3});
+    x->values().uniform();
+    NodeShPtr<double> after_sequence = rnn->call(x);
+
+    rnn->hPrev() = Node<double>::create({size_t(4)});
+    rnn->hPrev()->setAllValues(0);
+    NodeShPtr<double> from_zero = rnn->call(x);
+    EXPECT_EQ(after_sequence->shape(), Index({2, 4}));
+    EXPECT_EQ(after_sequence->values().rawData(), from_zero->values().rawData());
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
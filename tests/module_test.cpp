@@ -1,7 +1,15 @@
 
 #include "common_modules.h"
 #include "forward_declare.h"
+#include "gradient_accumulator.h"
 #include "node.h"
+#include "optimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
 #include <gtest/gtest-param-test.h>
 #include <gtest/gtest.h>
 
@@ -80,4 +88,552 @@ TEST(InputOutputTest, DiskTest)
     auto result2 = model2.call(input);
 
     EXPECT_EQ(result->value(), result2->value());
-}
\ No newline at end of file
+}
+
+TEST(InputOutputTest, Checkpoint)
+{
+    TestModel model;
+    for(auto weight : model.weights()) {
+        weight->values().uniform();
+    }
+    model.packParameters();
+    model.saveToFile("checkpoint_test");
+
+    {
+        MappedFile       file("checkpoint_test.snnl");
+        CheckpointHeader header = readCheckpointHeader(file, "checkpoint_test.snnl");
+        EXPECT_EQ(header.type, idxTypeCode<float>());
+        ASSERT_EQ(header.entries.size(), 6);
+        EXPECT_EQ(header.entries[0].name, "weight0");
+        EXPECT_EQ(header.entries[2].shape, model.dense2->W()->shape());
+        for(auto& entry : header.entries) {
+            EXPECT_EQ(entry.offset % CHECKPOINT_ALIGNMENT, 0);
+        }
+    }
+
+    NodeShPtr<float> input = Node<float>::create({16, 1});
+    input->values().uniform();
+
+    TestModel loaded;
+    loaded.loadFromFile("checkpoint_test.snnl");
+    EXPECT_EQ(loaded.toByteArray(), model.toByteArray());
+    EXPECT_EQ(loaded.call(input)->values().toByteArray(),
+              model.call(input)->values().toByteArray());
+
+    // Files of the former format are still read
+    {
+        std::vector<uint8_t> bytes = model.toByteArray();
+        std::ofstream        legacy("legacy_test.snnl", std::ios::binary);
+        legacy.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    TestModel legacy;
+    legacy.loadFromFile("legacy_test");
+    EXPECT_EQ(legacy.toByteArray(), model.toByteArray());
+
+    // Flip a value of the last weight
+    {
+        std::fstream file("checkpoint_test.snnl", std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(-1, std::ios::end);
+        file.put(char(0x55));
+    }
+    EXPECT_THROW(loaded.loadFromFile("checkpoint_test.snnl"), std::runtime_error);
+
+    struct OtherModel : public Module<float>
+    {
+        OtherModel()
+        {
+            addModule<DenseModule>(1, 64);
+            addModule<DenseModule>(64, 8);
+            addModule<DenseModule>(8, 1);
+        }
+
+        virtual NodeShPtr<float> callHandler(std::vector<NodeShPtr<float>> input) override
+        {
+            return input.at(0);
+        }
+    };
+    model.saveToFile("checkpoint_test.snnl");
+    OtherModel other;
+    EXPECT_THROW(other.loadFromFile("checkpoint_test.snnl"), std::domain_error);
+    EXPECT_THROW(other.loadFromFile("missing_test.snnl"), std::invalid_argument);
+}
+
+struct WideModel : public Module<double>
+{
+    DenseModuleShPtr<double> dense1;
+    DenseModuleShPtr<double> dense2;
+
+    WideModel()
+    {
+        // More than PARALLEL_GRAIN_SIZE weights in the first layer
+        dense1 = addModule<DenseModule>(64, 100);
+        dense2 = addModule<DenseModule>(100, 3);
+    }
+
+    virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> input) override
+    {
+        return dense2->call(Sigmoid(dense1->call(input)));
+    }
+};
+
+TEST(OptimizerTest, Adam)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 64});
+    NodeShPtr<double> target = Node<double>::create({8, 3});
+    input->values().uniform();
+    target->values().uniform();
+
+    WideModel model;
+    WideModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    double alpha = 0.01, beta_1 = 0.9, beta_2 = 0.999;
+
+    AdamOptimizer<double> optimizer(alpha, beta_1, beta_2);
+
+    auto& reference_weights = reference.weightsSortedByInsertion();
+
+    std::vector<std::vector<double>> m(reference_weights.size());
+    std::vector<std::vector<double>> v(reference_weights.size());
+
+    for(size_t t = 1; t <= 3; t++) {
+        auto loss = MSE(model.call(input), target);
+        loss->computeGrad();
+        optimizer.optimizeStep(loss);
+
+        // Textbook Adam with one step counter for all weights
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        for(size_t w = 0; w < reference_weights.size(); w++) {
+            auto& theta = reference_weights[w]->values().rawData();
+            auto& g     = reference_weights[w]->gradient().rawData();
+            m[w].resize(theta.size(), 0);
+            v[w].resize(theta.size(), 0);
+            for(size_t i = 0; i < theta.size(); i++) {
+                m[w][i] = beta_1 * m[w][i] + (1 - beta_1) * g[i];
+                v[w][i] = beta_2 * v[w][i] + (1 - beta_2) * g[i] * g[i];
+                double m_hat = m[w][i] / (1 - std::pow(beta_1, t));
+                double v_hat = v[w][i] / (1 - std::pow(beta_2, t));
+
+                theta[i] -= alpha * m_hat / (std::sqrt(v_hat) + 1e-8);
+            }
+        }
+    }
+
+    auto& weights = model.weightsSortedByInsertion();
+    for(size_t w = 0; w < weights.size(); w++) {
+        auto& values           = weights[w]->values().rawData();
+        auto& reference_values = reference_weights[w]->values().rawData();
+        for(size_t i = 0; i < values.size(); i++) {
+            EXPECT_NEAR(values[i], reference_values[i], 1e-12);
+        }
+    }
+}
+
+TEST(OptimizerTest, BoundWeights)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 64});
+    NodeShPtr<double> target = Node<double>::create({8, 3});
+    input->values().uniform();
+    target->values().uniform();
+
+    WideModel model;
+    WideModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    AdamOptimizer<double> optimizer;
+    AdamOptimizer<double> reference_optimizer;
+
+    auto weights = model.weightsSortedByInsertion();
+    optimizer.bind(weights);
+
+    for(size_t step = 0; step < 4; step++) {
+        if(step == 2) {
+            // Rebinding keeps the states of the weights
+            std::reverse(weights.begin(), weights.end());
+            optimizer.bind(weights);
+        }
+
+        auto loss = MSE(model.call(input), target);
+        loss->computeGrad();
+        optimizer.optimizeStep();
+
+        // Binds to the weights found in the graph
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        reference_optimizer.optimizeStep(reference_loss);
+    }
+
+    EXPECT_EQ(reference_optimizer.boundWeights().size(), weights.size());
+
+    auto& reference_weights = reference.weightsSortedByInsertion();
+    for(size_t w = 0; w < reference_weights.size(); w++) {
+        auto& values           = model.weightsSortedByInsertion()[w]->values().rawData();
+        auto& reference_values = reference_weights[w]->values().rawData();
+        for(size_t i = 0; i < values.size(); i++) {
+            EXPECT_EQ(values[i], reference_values[i]);
+        }
+    }
+}
+
+TEST(OptimizerTest, AlternatingLosses)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 4});
+    NodeShPtr<double> target = Node<double>::create({8, 2});
+    input->values().uniform();
+    target->values().uniform();
+
+    // Two models with disjoint weights, e.g. a generator and a discriminator
+    std::array<DenseModuleShPtr<double>, 2> models;
+    std::array<DenseModuleShPtr<double>, 2> references;
+    for(size_t m = 0; m < 2; m++) {
+        models[m]     = Module<double>::create<DenseModule>(4, 2);
+        references[m] = Module<double>::create<DenseModule>(4, 2);
+        references[m]->fromByteArray(models[m]->toByteArray());
+    }
+
+    // SGD with momentum has states per weight only, so a shared optimizer
+    // equals one optimizer per model
+    SGDOptimizer<double>                optimizer(0.1, 0.9);
+    std::array<SGDOptimizer<double>, 2> reference_optimizers = {
+        SGDOptimizer<double>(0.1, 0.9), SGDOptimizer<double>(0.1, 0.9)};
+
+    for(size_t step = 0; step < 6; step++) {
+        size_t m     = step % 2;
+        auto   other = models[1 - m]->toByteArray();
+
+        auto loss = MSE(models[m]->call(input), target);
+        loss->computeGrad();
+        optimizer.optimizeStep(loss);
+
+        auto reference_loss = MSE(references[m]->call(input), target);
+        reference_loss->computeGrad();
+        reference_optimizers[m].optimizeStep(reference_loss);
+
+        EXPECT_EQ(models[m]->toByteArray(), references[m]->toByteArray());
+        EXPECT_EQ(models[1 - m]->toByteArray(), other);
+    }
+    EXPECT_EQ(optimizer.boundWeights().size(), 4);
+}
+
+TEST(PackedParametersTest, Pack)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 64});
+    NodeShPtr<double> target = Node<double>::create({8, 3});
+    input->values().uniform();
+    target->values().uniform();
+
+    WideModel model;
+    WideModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    model.packParameters();
+    ASSERT_TRUE(model.isPacked());
+    EXPECT_EQ(model.toByteArray(), reference.toByteArray());
+
+    // Weights lie consecutively in the buffers, also for the child modules
+    double* values   = model.parameterBuffer().data();
+    double* gradient = model.gradientBuffer().data();
+    for(auto& weight : model.weightsSortedByInsertion()) {
+        EXPECT_EQ(weight->values().data(), values);
+        EXPECT_EQ(weight->gradient().data(), gradient);
+        values += weight->NElems();
+        gradient += weight->NElems();
+    }
+    EXPECT_EQ(values, model.parameterBuffer().data() + model.parameterBuffer().NElems());
+
+    ASSERT_TRUE(model.dense2->isPacked());
+    EXPECT_EQ(model.dense2->parameterBuffer().data(),
+              model.dense2->weightsSortedByInsertion().front()->values().data());
+
+    AdamOptimizer<double> optimizer;
+    AdamOptimizer<double> reference_optimizer;
+
+    for(size_t step = 0; step < 3; step++) {
+        auto loss = MSE(model.call(input), target);
+        loss->computeGrad();
+        optimizer.optimizeStep(loss);
+
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        reference_optimizer.optimizeStep(reference_loss);
+
+        EXPECT_EQ(loss->value(), reference_loss->value());
+    }
+    EXPECT_EQ(model.toByteArray(), reference.toByteArray());
+
+    model.zeroGradients();
+    for(auto& weight : model.weightsSortedByInsertion()) {
+        for(double val : weight->gradient()) {
+            EXPECT_EQ(val, 0);
+        }
+    }
+}
+
+// Train a WideModel with optimizer and a copy with reference_step, which
+// updates the values of weight w in step t (starting at 1) given its gradient
+void compareWithReference(
+    Optimizer<double>&                                                              optimizer,
+    std::function<void(size_t, std::vector<double>&, std::vector<double>&, size_t)> reference_step)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 64});
+    NodeShPtr<double> target = Node<double>::create({8, 3});
+    input->values().uniform();
+    target->values().uniform();
+
+    WideModel model;
+    WideModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    auto& weights           = model.weightsSortedByInsertion();
+    auto& reference_weights = reference.weightsSortedByInsertion();
+
+    for(size_t t = 1; t <= 3; t++) {
+        auto loss = MSE(model.call(input), target);
+        loss->computeGrad();
+        optimizer.optimizeStep(loss);
+
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        for(size_t w = 0; w < reference_weights.size(); w++) {
+            reference_step(w, reference_weights[w]->values().rawData(),
+                           reference_weights[w]->gradient().rawData(), t);
+        }
+    }
+
+    for(size_t w = 0; w < weights.size(); w++) {
+        auto& values           = weights[w]->values().rawData();
+        auto& reference_values = reference_weights[w]->values().rawData();
+        for(size_t i = 0; i < values.size(); i++) {
+            EXPECT_NEAR(values[i], reference_values[i], 1e-12);
+        }
+    }
+}
+
+double norm(const std::vector<double>& values)
+{
+    double sum = 0;
+    for(double val : values) {
+        sum += val * val;
+    }
+    return std::sqrt(sum);
+}
+
+TEST(OptimizerTest, SGDMomentum)
+{
+    for(bool nesterov : {false, true}) {
+        SGDOptimizer<double> optimizer(0.1, 0.9, nesterov);
+
+        std::map<size_t, std::vector<double>> velocity;
+        compareWithReference(optimizer, [&](size_t w, auto& theta, auto& g, size_t) {
+            velocity[w].resize(theta.size(), 0);
+            for(size_t i = 0; i < theta.size(); i++) {
+                velocity[w][i] = 0.9 * velocity[w][i] + g[i];
+                theta[i] -= 0.1 * (nesterov ? g[i] + 0.9 * velocity[w][i] : velocity[w][i]);
+            }
+        });
+    }
+
+    EXPECT_THROW(SGDOptimizer<double>(0.1, 0, true), std::invalid_argument);
+}
+
+TEST(OptimizerTest, LAMB)
+{
+    double alpha = 0.01, beta_1 = 0.9, beta_2 = 0.999, decay = 0.01, epsilon = 1e-6;
+
+    LAMBOptimizer<double> optimizer(alpha, beta_1, beta_2, decay, epsilon);
+
+    std::map<size_t, std::vector<double>> m;
+    std::map<size_t, std::vector<double>> v;
+    compareWithReference(optimizer, [&](size_t w, auto& theta, auto& g, size_t t) {
+        m[w].resize(theta.size(), 0);
+        v[w].resize(theta.size(), 0);
+
+        std::vector<double> r(theta.size());
+        for(size_t i = 0; i < theta.size(); i++) {
+            m[w][i] = beta_1 * m[w][i] + (1 - beta_1) * g[i];
+            v[w][i] = beta_2 * v[w][i] + (1 - beta_2) * g[i] * g[i];
+
+            double m_hat = m[w][i] / (1 - std::pow(beta_1, t));
+            double v_hat = v[w][i] / (1 - std::pow(beta_2, t));
+
+            r[i] = m_hat / (std::sqrt(v_hat) + epsilon) + decay * theta[i];
+        }
+
+        // Biases start at zero and are updated without trust ratio at first
+        double trust_ratio = norm(theta) > 0 ? norm(theta) / norm(r) : 1;
+        for(size_t i = 0; i < theta.size(); i++) {
+            theta[i] -= alpha * trust_ratio * r[i];
+        }
+    });
+}
+
+TEST(OptimizerTest, LARS)
+{
+    double rate = 1, momentum = 0.9, decay = 0.0005, eta = 0.001;
+
+    LARSOptimizer<double> optimizer(rate, momentum, decay, eta);
+
+    std::map<size_t, std::vector<double>> velocity;
+    compareWithReference(optimizer, [&](size_t w, auto& theta, auto& g, size_t) {
+        velocity[w].resize(theta.size(), 0);
+
+        double local_rate = 1;
+        if(norm(theta) > 0) {
+            local_rate = eta * norm(theta) / (norm(g) + decay * norm(theta));
+        }
+        for(size_t i = 0; i < theta.size(); i++) {
+            velocity[w][i] =
+                momentum * velocity[w][i] + rate * local_rate * (g[i] + decay * theta[i]);
+            theta[i] -= velocity[w][i];
+        }
+    });
+}
+
+TEST(OptimizerTest, QuantizedStates)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 64});
+    NodeShPtr<double> target = Node<double>::create({8, 3});
+    input->values().uniform();
+    target->values().uniform();
+
+    WideModel model;
+    WideModel reference;
+    WideModel initial;
+    reference.fromByteArray(model.toByteArray());
+    initial.fromByteArray(model.toByteArray());
+
+    AdamOptimizer<double> optimizer(0.01);
+    AdamOptimizer<double> reference_optimizer(0.01);
+    optimizer.setStatePrecision(StatePrecision::Blockwise8Bit);
+
+    double first_loss = 0, last_loss = 0;
+    for(size_t step = 0; step < 20; step++) {
+        auto loss = MSE(model.call(input), target);
+        loss->computeGrad();
+        optimizer.optimizeStep(loss);
+
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        reference_optimizer.optimizeStep(reference_loss);
+
+        if(step == 0) {
+            first_loss = loss->value();
+        }
+        last_loss = loss->value();
+    }
+    EXPECT_LT(last_loss, first_loss);
+
+    // The quantization error of single elements adds up over the steps, but
+    // on average the weights follow the full precision ones
+    auto& weights           = model.weightsSortedByInsertion();
+    auto& reference_weights = reference.weightsSortedByInsertion();
+    auto& initial_weights   = initial.weightsSortedByInsertion();
+
+    double deviation = 0, movement = 0;
+    for(size_t w = 0; w < weights.size(); w++) {
+        auto& values           = weights[w]->values().rawData();
+        auto& reference_values = reference_weights[w]->values().rawData();
+        auto& initial_values   = initial_weights[w]->values().rawData();
+        for(size_t i = 0; i < values.size(); i++) {
+            deviation += std::abs(values[i] - reference_values[i]);
+            movement += std::abs(reference_values[i] - initial_values[i]);
+        }
+    }
+    EXPECT_LT(deviation, 0.05 * movement);
+
+    // One byte per element and one scale per block instead of eight bytes
+    EXPECT_LT(optimizer.stateBytes() * 7, reference_optimizer.stateBytes());
+
+    EXPECT_THROW(optimizer.setStatePrecision(StatePrecision::Full), std::runtime_error);
+}
+
+TEST(GradientAccumulatorTest, MatchesFullBatch)
+{
+    NodeShPtr<double> input  = Node<double>::create({8, 64});
+    NodeShPtr<double> target = Node<double>::create({8, 3});
+    input->values().uniform();
+    target->values().uniform();
+
+    WideModel model;
+    WideModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    AdamOptimizer<double>       optimizer;
+    AdamOptimizer<double>       reference_optimizer;
+    GradientAccumulator<double> accumulator(optimizer, 4);
+
+    for(size_t step = 0; step < 2; step++) {
+        for(size_t m = 0; m < 4; m++) {
+            auto micro_input  = Node<double>::create({2, 64});
+            auto micro_target = Node<double>::create({2, 3});
+            micro_input->values() = input->values().viewAs(range(2 * m, 2 * m + 2), ellipsis());
+            micro_target->values() =
+                target->values().viewAs(range(2 * m, 2 * m + 2), ellipsis());
+
+            EXPECT_EQ(accumulator.backward(MSE(model.call(micro_input), micro_target)), m == 3);
+        }
+
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        reference_optimizer.optimizeStep(reference_loss);
+
+        EXPECT_NEAR(accumulator.stepLoss(), reference_loss->value(), 1e-12);
+    }
+
+    auto& weights           = model.weightsSortedByInsertion();
+    auto& reference_weights = reference.weightsSortedByInsertion();
+    for(size_t w = 0; w < weights.size(); w++) {
+        auto& values           = weights[w]->values().rawData();
+        auto& reference_values = reference_weights[w]->values().rawData();
+        for(size_t i = 0; i < values.size(); i++) {
+            EXPECT_NEAR(values[i], reference_values[i], 1e-12);
+        }
+    }
+}
+
+TEST(GradientAccumulatorTest, DisjointMicroBatches)
+{
+    NodeShPtr<double> input  = Node<double>::create({2, 4});
+    NodeShPtr<double> target = Node<double>::create({2, 2});
+    input->values().uniform();
+    target->values().uniform();
+
+    // Each micro-batch reaches the weights of one model only, e.g. per-task
+    // heads
+    std::array<DenseModuleShPtr<double>, 2> models;
+    std::array<DenseModuleShPtr<double>, 2> references;
+    for(size_t m = 0; m < 2; m++) {
+        models[m]     = Module<double>::create<DenseModule>(4, 2);
+        references[m] = Module<double>::create<DenseModule>(4, 2);
+        references[m]->fromByteArray(models[m]->toByteArray());
+    }
+
+    // The mean over both micro-batches halves the gradients
+    SGDOptimizer<double>                optimizer(0.1);
+    std::array<SGDOptimizer<double>, 2> reference_optimizers = {SGDOptimizer<double>(0.05),
+                                                                SGDOptimizer<double>(0.05)};
+    GradientAccumulator<double>         accumulator(optimizer, 2);
+
+    for(size_t step = 0; step < 3; step++) {
+        for(size_t m = 0; m < 2; m++) {
+            accumulator.backward(MSE(models[m]->call(input), target));
+
+            auto reference_loss = MSE(references[m]->call(input), target);
+            reference_loss->computeGrad();
+            reference_optimizers[m].optimizeStep(reference_loss);
+        }
+
+        for(size_t m = 0; m < 2; m++) {
+            auto& weights           = models[m]->weightsSortedByInsertion();
+            auto& reference_weights = references[m]->weightsSortedByInsertion();
+            for(size_t w = 0; w < weights.size(); w++) {
+                auto& values           = weights[w]->values().rawData();
+                auto& reference_values = reference_weights[w]->values().rawData();
+                for(size_t i = 0; i < values.size(); i++) {
+                    EXPECT_NEAR(values[i], reference_values[i], 1e-12);
+                }
+            }
+        }
+    }
+}
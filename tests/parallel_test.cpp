@@ -0,0 +1,1080 @@
+#include "async_evaluator.h"
+#include "augmentation.h"
+#include "batch_generator.h"
+#include "batch_prefetcher.h"
+#include "common_modules.h"
+#include "data_parallel_trainer.h"
+#include "distributed.h"
+#include "evaluator.h"
+#include "forward_declare.h"
+#include "hogwild_trainer.h"
+#include "mapped_batch_generator.h"
+#include "node.h"
+#include "optimizer.h"
+#include "pipeline_trainer.h"
+#include "random_permutation.h"
+#include "sequence_batch_generator.h"
+#include "sharded_dataset.h"
+#include "statistics.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace snnl;
+
+TEST(ThreadPoolTest, ParallelForCoversRange)
+{
+    setNumThreads(4);
+
+    std::vector<int> visited(10007, 0);
+    parallelFor(3, visited.size(), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) {
+            visited[i]++;
+        }
+    });
+
+    for(size_t i = 0; i < visited.size(); i++) {
+        EXPECT_EQ(visited[i], i < 3 ? 0 : 1);
+    }
+}
+
+TEST(ThreadPoolTest, ParallelReduce)
+{
+    setNumThreads(4);
+
+    size_t sum = parallelReduce(
+        0, 100001, size_t(0),
+        [](size_t begin, size_t end) {
+            size_t partial = 0;
+            for(size_t i = begin; i < end; i++) {
+                partial += i;
+            }
+            return partial;
+        },
+        std::plus<size_t>(), 100);
+
+    EXPECT_EQ(sum, size_t(100000) * 100001 / 2);
+}
+
+TEST(ThreadPoolTest, NestedLoopsRunInline)
+{
+    setNumThreads(4);
+
+    std::atomic<size_t> count = 0;
+    parallelFor(0, 16, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) {
+            parallelFor(0, 16, [&](size_t inner_begin, size_t inner_end) {
+                count += inner_end - inner_begin;
+            });
+        }
+    });
+    EXPECT_EQ(count, 256);
+}
+
+TEST(ThreadPoolTest, ExceptionIsRethrown)
+{
+    setNumThreads(4);
+
+    EXPECT_THROW(parallelFor(0, 64,
+                             [](size_t begin, size_t) {
+                                 if(begin != 0) {
+                                     throw std::runtime_error("Failure in worker");
+                                 }
+                             }),
+                 std::runtime_error);
+}
+
+TEST(ThreadPoolTest, SetNumThreads)
+{
+    setNumThreads(3);
+    EXPECT_EQ(numThreads(), 3);
+    setNumThreads(1);
+    EXPECT_EQ(numThreads(), 1);
+}
+
+struct ConvModel : public Module<double>
+{
+    std::shared_ptr<Conv2DModule<double>> conv2d;
+    DenseModuleShPtr<double>              dense;
+
+    ConvModel()
+    {
+        conv2d = addModule<Conv2DModule>(3, 3, 2, 4);
+        dense  = addModule<DenseModule>(4 * 4 * 2, 5);
+    }
+
+    virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+    {
+        auto out = ReLU(conv2d->call(inputs.at(0)));
+        out      = AveragePooling(out, 2, 2);
+        out      = Flatten(out);
+        out      = SoftMax(dense->call(out));
+        return SparseCategoricalCrosseEntropy(out, inputs.at(1));
+    }
+};
+
+TEST(ThreadPoolTest, ResultsIndependentOfThreadCount)
+{
+    ConvModel model;
+
+    NodeShPtr<double> images = Node<double>::create({7, 8, 4, 2});
+    NodeShPtr<double> labels = Node<double>::create({7});
+    images->values().uniform();
+    for(size_t i = 0; i < labels->shape(0); i++) {
+        labels->value(i) = i % 5;
+    }
+
+    auto compute = [&](size_t num_threads) {
+        setNumThreads(num_threads);
+        auto loss = model.call(images, labels);
+        loss->computeGrad();
+
+        std::vector<Tensor<double>> grads;
+        grads.push_back(loss->values().copy());
+        for(auto& weight : model.weights()) {
+            grads.push_back(weight->gradient().copy());
+        }
+        return grads;
+    };
+
+    auto serial   = compute(1);
+    auto parallel = compute(5);
+
+    ASSERT_EQ(serial.size(), parallel.size());
+    for(size_t i = 0; i < serial.size(); i++) {
+        auto it = parallel[i].begin();
+        for(double val : serial[i]) {
+            EXPECT_NEAR(val, *it, 1e-12);
+            ++it;
+        }
+    }
+}
+
+struct RegressionModel : public Module<double>
+{
+    DenseModuleShPtr<double> dense_1;
+    DenseModuleShPtr<double> dense_2;
+
+    RegressionModel()
+    {
+        dense_1 = addModule<DenseModule>(4, 8);
+        dense_2 = addModule<DenseModule>(8, 2);
+    }
+
+    virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+    {
+        return dense_2->call(Sigmoid(dense_1->call(inputs.at(0))));
+    }
+};
+
+template<typename TModel>
+void compareDataParallelTraining(
+    typename DataParallelTrainer<double>::LossFunction loss_function, LossReduction reduction,
+    NodeShPtr<double> input, NodeShPtr<double> target)
+{
+    setNumThreads(3);
+
+    TModel model;
+    TModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    DataParallelTrainer<double> trainer(
+        model,
+        [] {
+            return std::make_shared<TModel>();
+        },
+        4, loss_function, reduction);
+
+    SGDOptimizer<double> optimizer(0.1);
+    SGDOptimizer<double> reference_optimizer(0.1);
+
+    for(size_t step = 0; step < 3; step++) {
+        double loss = trainer.trainStep({input, target}, optimizer);
+
+        auto reference_loss = loss_function(reference, {input, target});
+        reference_loss->computeGrad();
+        reference_optimizer.optimizeStep(reference_loss);
+
+        EXPECT_NEAR(loss, reference_loss->value(), 1e-10);
+    }
+
+    auto& weights           = model.weightsSortedByInsertion();
+    auto& reference_weights = reference.weightsSortedByInsertion();
+    ASSERT_EQ(weights.size(), reference_weights.size());
+    for(size_t w = 0; w < weights.size(); w++) {
+        auto it = reference_weights[w]->values().begin();
+        for(double val : weights[w]->values()) {
+            EXPECT_NEAR(val, *it, 1e-10);
+            ++it;
+        }
+    }
+}
+
+TEST(DataParallelTrainerTest, MeanLoss)
+{
+    // Shards of 3, 3, 3 and 4 samples
+    NodeShPtr<double> input  = Node<double>::create({13, 4});
+    NodeShPtr<double> target = Node<double>::create({13, 2});
+    input->values().uniform();
+    target->values().uniform();
+
+    compareDataParallelTraining<RegressionModel>(
+        [](Module<double>& replica, std::vector<NodeShPtr<double>> batch) {
+            return MSE(replica.call(batch.at(0)), batch.at(1));
+        },
+        LossReduction::Mean, input, target);
+}
+
+TEST(DataParallelTrainerTest, SumLoss)
+{
+    NodeShPtr<double> images = Node<double>::create({6, 8, 4, 2});
+    NodeShPtr<double> labels = Node<double>::create({6});
+    images->values().uniform();
+    for(size_t i = 0; i < labels->shape(0); i++) {
+        labels->value(i) = i % 5;
+    }
+
+    compareDataParallelTraining<ConvModel>(
+        [](Module<double>& replica, std::vector<NodeShPtr<double>> batch) {
+            return replica.call(batch.at(0), batch.at(1));
+        },
+        LossReduction::Sum, images, labels);
+}
+
+TEST(DataParallelTrainerTest, MismatchingReplica)
+{
+    RegressionModel model;
+
+    EXPECT_THROW(DataParallelTrainer<double>(
+                     model,
+                     [] {
+                         return std::make_shared<ConvModel>();
+                     },
+                     2,
+                     [](Module<double>& replica, std::vector<NodeShPtr<double>> batch) {
+                         return replica.call(batch.at(0));
+                     }),
+                 std::invalid_argument);
+}
+
+struct SequentialModel : public Module<double>
+{
+    SequentialModel()
+    {
+        addModule<DenseModule>(4, 8);
+        addModule<FunctionModule>(Sigmoid<double>);
+        addModule<DenseModule>(8, 8);
+        addModule<FunctionModule>(Sigmoid<double>);
+        addModule<DenseModule>(8, 2);
+    }
+
+    virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+    {
+        NodeShPtr<double> output = inputs.at(0);
+        for(auto& module : modulesSortedByInsertion()) {
+            output = module->call(output);
+        }
+        return output;
+    }
+};
+
+TEST(PipelineTrainerTest, MatchesFullBatch)
+{
+    setNumThreads(2);
+
+    // Micro-batches of 2, 3, 2 and 3 samples
+    NodeShPtr<double> input  = Node<double>::create({10, 4});
+    NodeShPtr<double> target = Node<double>::create({10, 2});
+    input->values().uniform();
+    target->values().uniform();
+
+    SequentialModel model;
+    SequentialModel reference;
+    reference.fromByteArray(model.toByteArray());
+
+    PipelineTrainer<double> trainer(
+        model, 3, 4, [](NodeShPtr<double> output, std::vector<NodeShPtr<double>> targets) {
+            return MSE(output, targets.at(0));
+        });
+    // Balanced by weights: Dense + Sigmoid, Dense, Sigmoid + Dense
+    ASSERT_EQ(trainer.numStages(), 3);
+    EXPECT_EQ(trainer.stageModules(0).size(), 2);
+    EXPECT_EQ(trainer.stageModules(1).size(), 1);
+    EXPECT_EQ(trainer.stageModules(2).size(), 2);
+
+    SGDOptimizer<double> optimizer(0.1);
+    SGDOptimizer<double> reference_optimizer(0.1);
+
+    for(size_t step = 0; step < 3; step++) {
+        double loss = trainer.trainStep({input, target}, optimizer);
+
+        auto reference_loss = MSE(reference.call(input), target);
+        reference_loss->computeGrad();
+        reference_optimizer.optimizeStep(reference_loss);
+
+        EXPECT_NEAR(loss, reference_loss->value(), 1e-10);
+    }
+
+    auto& weights           = model.weightsSortedByInsertion();
+    auto& reference_weights = reference.weightsSortedByInsertion();
+    ASSERT_EQ(weights.size(), reference_weights.size());
+    for(size_t w = 0; w < weights.size(); w++) {
+        auto it = reference_weights[w]->values().begin();
+        for(double val : weights[w]->values()) {
+            EXPECT_NEAR(val, *it, 1e-10);
+            ++it;
+        }
+    }
+}
+
+TEST(PipelineTrainerTest, TooManyStages)
+{
+    RegressionModel model;
+
+    EXPECT_THROW(PipelineTrainer<double>(model, 3, 4,
+                                         [](NodeShPtr<double> output,
+                                            std::vector<NodeShPtr<double>> targets) {
+                                             return MSE(output, targets.at(0));
+                                         }),
+                 std::invalid_argument);
+}
+
+TEST(HogwildTrainerTest, Converges)
+{
+    setNumThreads(4);
+
+    struct LinearModel : public Module<double>
+    {
+        DenseModuleShPtr<double> dense;
+
+        LinearModel() { dense = addModule<DenseModule>(4, 1); }
+
+        virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+        {
+            return dense->call(inputs.at(0));
+        }
+    };
+
+    Tensor<double> x({256, 4});
+    Tensor<double> y({256, 1});
+    x.uniform();
+    for(size_t i = 0; i < x.shape(0); i++) {
+        y(i, 0) = 0.5 + x(i, 0) - 2 * x(i, 1) + 0.25 * x(i, 3);
+    }
+
+    LinearModel model;
+    auto        loss_function = [](Module<double>& replica, std::vector<NodeShPtr<double>> batch) {
+        return MSE(replica.call(batch.at(0)), batch.at(1));
+    };
+
+    std::vector<std::shared_ptr<LinearModel>> replicas;
+
+    HogwildTrainer<double> trainer(
+        model,
+        [&] {
+            replicas.push_back(std::make_shared<LinearModel>());
+            return replicas.back();
+        },
+        4, loss_function, 0.1);
+
+    std::vector<BatchGenerator<double, 2>> generators;
+    for(size_t i = 0; i < trainer.numWorkers(); i++) {
+        generators.emplace_back(x, y);
+        generators.back().mute();
+        generators.back().setSeed(i);
+    }
+
+    double initial_loss = loss_function(model, {Node<double>::create(x), Node<double>::create(y)})
+                              ->value();
+    trainer.train(generators, 8, 300);
+    double final_loss = loss_function(model, {Node<double>::create(x), Node<double>::create(y)})
+                            ->value();
+
+    EXPECT_LT(final_loss, 1e-3);
+    EXPECT_LT(final_loss, initial_loss);
+
+    // All replicas work on the weights of the model
+    ASSERT_EQ(replicas.size(), 3);
+    for(auto& replica : replicas) {
+        EXPECT_EQ(&replica->dense->W()->values()(0, 0), &model.dense->W()->values()(0, 0));
+    }
+}
+
+void runDistributedTraining(CommunicationBackend backend, uint16_t base_port)
+{
+    setNumThreads(2);
+
+    // Shards of 4 samples per process
+    Tensor<double> x({12, 4});
+    Tensor<double> y({12, 2});
+    x.uniform();
+    y.uniform();
+
+    RegressionModel model;
+    auto            initial_weights = model.toByteArray();
+
+    launchProcesses<double>(
+        3, model,
+        [&](Communicator<double>& communicator) {
+            size_t rank = communicator.rank();
+
+            // The trainer replaces these weights by those of rank 0
+            if(rank != 0) {
+                for(auto& weight : model.weightsSortedByInsertion()) {
+                    weight->values().uniform();
+                }
+            }
+            DistributedTrainer<double> trainer(model, communicator);
+
+            RegressionModel reference;
+            reference.fromByteArray(initial_weights);
+
+            auto input  = Node<double>::create({4, 4});
+            auto target = Node<double>::create({4, 2});
+
+            input->values()  = x.viewAs(range(4 * rank, 4 * rank + 4), all());
+            target->values() = y.viewAs(range(4 * rank, 4 * rank + 4), all());
+
+            SGDOptimizer<double> optimizer(0.1);
+            SGDOptimizer<double> reference_optimizer(0.1);
+
+            for(size_t step = 0; step < 3; step++) {
+                double loss = trainer.trainStep(MSE(model.call(input), target), optimizer);
+
+                auto reference_loss = MSE(reference.call(x), Node<double>::create(y));
+                reference_loss->computeGrad();
+                reference_optimizer.optimizeStep(reference_loss);
+
+                if(std::abs(loss - reference_loss->value()) > 1e-10) {
+                    throw std::runtime_error("Loss differs from reference");
+                }
+            }
+
+            auto& weights           = model.weightsSortedByInsertion();
+            auto& reference_weights = reference.weightsSortedByInsertion();
+            for(size_t w = 0; w < weights.size(); w++) {
+                auto it = reference_weights[w]->values().begin();
+                for(double val : weights[w]->values()) {
+                    if(std::abs(val - *it) > 1e-10) {
+                        throw std::runtime_error("Weights differ from reference");
+                    }
+                    ++it;
+                }
+            }
+        },
+        backend, base_port);
+}
+
+TEST(DistributedTest, SharedMemory)
+{
+    EXPECT_NO_THROW(runDistributedTraining(CommunicationBackend::SharedMemory, 0));
+}
+
+TEST(DistributedTest, Tcp)
+{
+    EXPECT_NO_THROW(runDistributedTraining(CommunicationBackend::Tcp, 20000 + getpid() % 20000));
+}
+
+TEST(DistributedTest, FailingWorker)
+{
+    RegressionModel model;
+
+    EXPECT_THROW(launchProcesses<double>(3, model,
+                                         [](Communicator<double>& communicator) {
+                                             if(communicator.rank() == 1) {
+                                                 throw std::runtime_error("Failure in worker");
+                                             }
+                                             // Would wait forever for rank 1
+                                             communicator.barrier();
+                                         }),
+                 std::runtime_error);
+}
+
+TEST(RandomPermutationTest, Bijective)
+{
+    for(size_t size : {1, 2, 3, 7, 64, 1000, 4097}) {
+        RandomPermutation permutation(size, 42);
+
+        std::vector<size_t> visited(size, 0);
+        for(size_t i = 0; i < size; i++) {
+            size_t element = permutation(i);
+            ASSERT_LT(element, size);
+            visited[element]++;
+        }
+        EXPECT_EQ(std::count(visited.begin(), visited.end(), 1), size);
+    }
+
+    // Other keys give other orders
+    RandomPermutation first(1000, 1);
+    RandomPermutation second(1000, 2);
+    size_t            num_equal = 0;
+    for(size_t i = 0; i < 1000; i++) {
+        num_equal += first(i) == second(i);
+    }
+    EXPECT_LT(num_equal, 20);
+
+    EXPECT_THROW(RandomPermutation(0, 42), std::domain_error);
+}
+
+TEST(BatchGeneratorTest, ReusesBatches)
+{
+    Tensor<double> x({6, 2});
+    Tensor<double> y({6, 1});
+    x.arangeAlongAxis(0, 0, 6);
+    y.arangeAlongAxis(0, 0, 6);
+
+    BatchGenerator<double, 2> generator(x, y);
+    generator.mute();
+
+    auto batch = generator.generateBatch(3);
+    for(size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(batch[0]->value(i, 1), batch[1]->value(i, 0));
+    }
+
+    // Tensors taken from a batch keep their values by default
+    Tensor<double> values   = batch[0]->values();
+    Tensor<double> expected = values.copy();
+    batch                   = {};
+    generator.generateBatch(3);
+    EXPECT_EQ(values.rawData(), expected.rawData());
+
+    generator.setReuseBatches(true);
+    batch = generator.generateBatch(3);
+
+    // Still held, so a new batch is created
+    auto held = generator.generateBatch(3);
+    EXPECT_NE(held[0].get(), batch[0].get());
+
+    Node<double>* last = held[0].get();
+    batch              = {};
+    held               = {};
+
+    auto reused = generator.generateBatch(3);
+    EXPECT_EQ(reused[0].get(), last);
+    for(size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(reused[0]->value(i, 0), reused[1]->value(i, 0));
+    }
+}
+
+TEST(BatchGeneratorTest, NoSamples)
+{
+    Tensor<float> x({0, 3});
+    Tensor<float> y({0, 1});
+    EXPECT_THROW((BatchGenerator<float, 2>(x, y)), std::domain_error);
+}
+
+TEST(BatchGeneratorTest, CompactStorage)
+{
+    // Two channels per pixel
+    Tensor<uint8_t>  x({5, 3, 2});
+    Tensor<uint16_t> y({5});
+    for(size_t i = 0; i < 5; i++) {
+        for(size_t j = 0; j < 3; j++) {
+            x(i, j, 0) = 10 * i;
+            x(i, j, 1) = 200 + i;
+        }
+        y(i) = 1000 * i;
+    }
+
+    BatchGenerator<float, 2, uint8_t> generator(x, x.viewAs({size_t(5), size_t(6)}));
+    generator.mute();
+    generator.setNormalization(0, {0.5f, 1.f}, {0.f, -200.f});
+
+    auto [images, flat] = generator.generateBatch(5);
+    for(size_t i = 0; i < 5; i++) {
+        size_t sample = flat->value(i, 0) / 10;
+        for(size_t j = 0; j < 3; j++) {
+            EXPECT_FLOAT_EQ(images->value(i, j, 0), 5.f * sample);
+            EXPECT_FLOAT_EQ(images->value(i, j, 1), sample);
+        }
+        EXPECT_FLOAT_EQ(flat->value(i, 1), 200 + sample);
+    }
+
+    BatchGenerator<double, 1, uint16_t> labels(y);
+    labels.mute();
+    labels.setNormalization(0, {0.001}, {1});
+    auto [label] = labels.generateBatch(5);
+    double sum   = 0;
+    for(size_t i = 0; i < 5; i++) {
+        sum += label->value(i);
+    }
+    EXPECT_DOUBLE_EQ(sum, 15);
+
+    EXPECT_THROW(generator.setNormalization(0, {1, 2, 3}, {0}), std::invalid_argument);
+}
+
+TEST(BatchGeneratorTest, SlidingWindows)
+{
+    // Predict the step after each window of 5 steps
+    Tensor<double> series({100, 3});
+    series.arangeAlongAxis(0, 0, 100);
+
+    long           num_steps = series.shape(0);
+    Tensor<double> inputs    = series.viewAs(range(0, num_steps - 1), all()).slidingWindows(5, 2);
+    Tensor<double> targets   = series.viewAs(range(5, num_steps), all()).slidingWindows(1, 2);
+    ASSERT_EQ(inputs.shape(), Index({48, 5, 3}));
+    ASSERT_EQ(targets.shape(), Index({48, 1, 3}));
+
+    BatchGenerator<double, 2> generator(inputs, targets);
+    generator.mute();
+
+    // The windows are read from the series itself
+    series(1, 2) = -1;
+    for(size_t step = 0; step < 30; step++) {
+        auto [input, target] = generator.generateBatch(8);
+        ASSERT_EQ(input->shape(), Index({8, 5, 3}));
+        for(size_t row = 0; row < 8; row++) {
+            double first = input->value(row, 0, 0);
+            for(size_t t = 0; t < 5; t++) {
+                EXPECT_EQ(input->value(row, t, 0), first + t);
+                EXPECT_EQ(input->value(row, t, 2), first + t == 1 ? -1 : first + t);
+            }
+            EXPECT_EQ(target->value(row, 0, 1), first + 5);
+        }
+    }
+}
+
+TEST(ImageAugmentationTest, FlipAndCrop)
+{
+    // Unique values > 0 per pixel
+    Tensor<double> images({8, 5, 6, 2});
+    for(size_t i = 0; i < images.NElems(); i++) {
+        images.data()[i] = i + 1;
+    }
+
+    ImageAugmentation<double> flip;
+    flip.setHorizontalFlip(1);
+    Tensor<double> flipped = images.copy();
+    flip(flipped, 0);
+    EXPECT_EQ(flipped(3, 2, 0, 1), images(3, 2, 5, 1));
+    EXPECT_EQ(flipped(3, 2, 4, 0), images(3, 2, 1, 0));
+
+    // Every image is shifted as a whole, pixels from the padding are zero
+    ImageAugmentation<double> crop;
+    crop.setRandomCrop(2);
+    Tensor<double> cropped = images.copy();
+    crop(cropped, 7);
+    for(size_t n = 0; n < 8; n++) {
+        long dy = 3, dx = 3;
+        for(long y = 0; y < 5; y++) {
+            for(long x = 0; x < 6; x++) {
+                double value = cropped(n, y, x, 1);
+                if(value == 0) {
+                    continue;
+                }
+                long source = (long(value) - 1) / 2 - n * 30;
+                if(dy == 3) {
+                    dy = source / 6 - y;
+                    dx = source % 6 - x;
+                }
+                EXPECT_EQ(source / 6 - y, dy);
+                EXPECT_EQ(source % 6 - x, dx);
+            }
+        }
+        EXPECT_LE(std::abs(dy), 2);
+        EXPECT_LE(std::abs(dx), 2);
+    }
+
+    Tensor<double> rows = flipped.viewAs({size_t(40), size_t(12)});
+    EXPECT_THROW(crop(rows, 0), std::invalid_argument);
+}
+
+TEST(ImageAugmentationTest, IndependentOfThreads)
+{
+    Tensor<float> images({16, 8, 8, 3});
+    images.uniform();
+
+    ImageAugmentation<float> augmentation;
+    augmentation.setHorizontalFlip(0.5);
+    augmentation.setTranslation(2);
+    augmentation.setCutout(3);
+    augmentation.setNoise(0.1);
+
+    Tensor<float> serial   = images.copy();
+    Tensor<float> parallel = images.copy();
+    setNumThreads(1);
+    augmentation(serial, 11);
+    setNumThreads(4);
+    augmentation(parallel, 11);
+
+    for(size_t i = 0; i < images.NElems(); i++) {
+        EXPECT_EQ(serial.data()[i], parallel.data()[i]);
+    }
+
+    // Attached to a generator, every batch is augmented
+    Tensor<float> labels({16});
+    BatchGenerator<float, 2> generator(images, labels);
+    generator.mute();
+
+    size_t num_calls = 0;
+    generator.setAugmentation(0, [&](Tensor<float>& batch, uint64_t seed) {
+        num_calls++;
+        augmentation(batch, seed);
+    });
+    generator.generateBatch(4);
+    generator.generateBatch(4);
+    EXPECT_EQ(num_calls, 2);
+}
+
+TEST(BatchPrefetcherTest, SameBatchesAsGenerator)
+{
+    Tensor<double> x({10, 3});
+    Tensor<double> y({10, 1});
+    x.uniform();
+    y.uniform();
+
+    BatchGenerator<double, 2> generator(x, y);
+    BatchGenerator<double, 2> reference(x, y);
+    generator.setSeed(3);
+    reference.setSeed(3);
+
+    std::vector<size_t> epochs;
+    std::vector<size_t> reference_epochs;
+    generator.setEpochCallBack([&](size_t epoch) {
+        epochs.push_back(epoch);
+    });
+    reference.setEpochCallBack([&](size_t epoch) {
+        reference_epochs.push_back(epoch);
+    });
+
+    {
+        BatchPrefetcher<double, 2> prefetcher(generator, 4, 3);
+
+        for(size_t step = 0; step < 12; step++) {
+            auto [input, target]                     = prefetcher.nextBatch();
+            auto [reference_input, reference_target] = reference.generateBatch(4);
+
+            // Epochs are reported on this thread before their last batch
+            EXPECT_EQ(epochs, reference_epochs);
+
+            ASSERT_EQ(input->shape(), reference_input->shape());
+            for(size_t i = 0; i < 4; i++) {
+                for(size_t j = 0; j < 3; j++) {
+                    EXPECT_EQ(input->value(i, j), reference_input->value(i, j));
+                }
+                EXPECT_EQ(target->value(i, 0), reference_target->value(i, 0));
+            }
+        }
+        // Shuts down with a full queue
+    }
+
+    // The callback is restored
+    generator.generateBatch(10);
+    EXPECT_EQ(epochs.size(), reference_epochs.size() + 1);
+}
+
+TEST(MappedBatchGeneratorTest, VisitsEverySample)
+{
+    Tensor<double> x({10, 2, 3});
+    Tensor<double> y({10, 1});
+    x.arangeAlongAxis(0, 0, 10);
+    y.arangeAlongAxis(0, 0, 10);
+    writeRawFile("mapped_x.raw", x);
+    writeRawFile("mapped_y.raw", y);
+
+    MappedBatchGenerator<double, 2> generator({"mapped_x.raw", "mapped_y.raw"}, {{{2, 3}, {1}}},
+                                              4);
+    EXPECT_EQ(generator.numSamples(), 10);
+
+    size_t epochs = 0;
+    generator.setEpochCallBack([&](size_t) {
+        epochs++;
+    });
+
+    // Each pass over the data is a permutation, also with a batch size which
+    // does not divide the number of samples
+    std::vector<size_t> visited(10, 0);
+    for(size_t step = 0; step < 10; step++) {
+        auto [input, target] = generator.generateBatch(3);
+        ASSERT_EQ(input->shape(), Index({3, 2, 3}));
+        for(size_t i = 0; i < 3; i++) {
+            EXPECT_EQ(input->value(i, 1, 2), target->value(i, 0));
+            visited[target->value(i, 0)]++;
+        }
+    }
+    for(size_t count : visited) {
+        EXPECT_EQ(count, 3);
+    }
+    EXPECT_EQ(epochs, 3);
+
+    // Batches of whole blocks keep the samples of a block together
+    MappedBatchGenerator<double, 2> blocked({"mapped_x.raw", "mapped_y.raw"}, {{{2, 3}, {1}}},
+                                            5);
+    blocked.mute();
+    for(size_t step = 0; step < 6; step++) {
+        auto [input, target] = blocked.generateBatch(5);
+        size_t block         = target->value(0, 0) / 5;
+        for(size_t i = 0; i < 5; i++) {
+            EXPECT_EQ(size_t(target->value(i, 0)) / 5, block);
+        }
+    }
+
+    EXPECT_THROW((MappedBatchGenerator<double, 2>({"mapped_x.raw", "mapped_y.raw"},
+                                                  {{{4}, {1}}})),
+                 std::domain_error);
+}
+
+TEST(ShardedDatasetTest, RandomAccessAcrossShards)
+{
+    Tensor<float> x({23, 2, 3});
+    Tensor<float> y({23, 1});
+    x.arangeAlongAxis(0, 0, 23);
+    y.arangeAlongAxis(0, 0, 23);
+
+    {
+        ShardedDatasetWriter<float, 2> writer("sharded.index", {{{2, 3}, {1}}}, 10);
+        writer.write({x, y});
+    }
+    ShardedDataset<float, 2> dataset("sharded.index");
+    EXPECT_EQ(dataset.numSamples(), 23);
+    EXPECT_EQ(dataset.numShards(), 3);
+    EXPECT_EQ(dataset.sampleShape(0), std::vector<size_t>({2, 3}));
+
+    auto batch = dataset.allocateBatch(4);
+    dataset.gather({22, 0, 10, 9}, batch);
+    EXPECT_EQ(batch[0].shape(), Index({4, 2, 3}));
+    EXPECT_EQ(batch[0](0, 1, 2), 22);
+    EXPECT_EQ(batch[0](2, 0, 0), 10);
+    EXPECT_EQ(batch[1](3, 0), 9);
+
+    // Consecutive samples spanning two shards
+    dataset.read(8, batch);
+    for(size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(batch[0](i, 1, 1), 8 + i);
+        EXPECT_EQ(batch[1](i, 0), 8 + i);
+    }
+    EXPECT_THROW(dataset.read(20, batch), std::out_of_range);
+    EXPECT_THROW(dataset.gather({1, 2, 3, 23}, batch), std::out_of_range);
+
+    // Shards written by separate jobs, indexed afterwards
+    {
+        ShardWriter<float, 2> first("job-0.shard", {{{2, 3}, {1}}});
+        ShardWriter<float, 2> second("job-1.shard", {{{2, 3}, {1}}});
+        first.write({x, y});
+        second.write({x, y});
+    }
+    writeShardIndex("jobs.index", {"job-0.shard", "job-1.shard"});
+
+    ShardedDataset<float, 2> jobs("jobs.index");
+    auto [inputs, targets] = jobs.load();
+    EXPECT_EQ(inputs.shape(), Index({46, 2, 3}));
+    for(size_t i = 0; i < 46; i++) {
+        EXPECT_EQ(inputs(i, 0, 1), i % 23);
+        EXPECT_EQ(targets(i, 0), i % 23);
+    }
+
+    BatchGenerator<float, 2> generator(inputs, targets);
+    auto [input, target] = generator.generateBatch(5);
+    EXPECT_EQ(input->value(4, 1, 0), target->value(4, 0));
+
+    {
+        ShardWriter<float, 1> other("job-2.shard", {{{6}}});
+    }
+    EXPECT_THROW(writeShardIndex("jobs.index", {"job-0.shard", "job-2.shard"}),
+                 std::domain_error);
+    EXPECT_THROW((ShardedDataset<double, 2>("sharded.index")), std::domain_error);
+}
+
+TEST(SequenceBatchGeneratorTest, BucketsByLength)
+{
+    // Sequences of 1 to 40 steps, which hold the number of the sample and the
+    // step
+    std::mt19937               rng(3);
+    std::vector<Tensor<float>> inputs;
+    std::vector<Tensor<float>> targets;
+    for(size_t sample = 0; sample < 300; sample++) {
+        size_t        length = std::uniform_int_distribution<size_t>(1, 40)(rng);
+        Tensor<float> input({length, size_t(2)});
+        Tensor<float> target({length, size_t(1)});
+        for(size_t step = 0; step < length; step++) {
+            input(step, 0)  = sample;
+            input(step, 1)  = step + 1;
+            target(step, 0) = sample;
+        }
+        inputs.push_back(input);
+        targets.push_back(target);
+    }
+
+    auto padding = [&](size_t pool_batches) {
+        SequenceBatchGenerator<float, 2> generator({inputs, targets}, 16, pool_batches);
+        generator.mute();
+
+        size_t padded_steps = 0;
+        size_t steps        = 0;
+
+        std::vector<size_t> visited(300, 0);
+        for(size_t batch_index = 0; batch_index < generator.numBatches(); batch_index++) {
+            auto batch = generator.generateBatch();
+            EXPECT_TRUE(std::is_sorted(batch.lengths.rbegin(), batch.lengths.rend()));
+            EXPECT_EQ(batch.tensors[0].shape(),
+                      Index({batch.maxLength(), batch.batchSize(), size_t(2)}));
+
+            for(size_t row = 0; row < batch.batchSize(); row++) {
+                size_t sample = batch.tensors[1](0, row, 0);
+                visited[sample]++;
+                EXPECT_EQ(batch.lengths[row], inputs[sample].shape(0));
+                for(size_t step = 0; step < batch.maxLength(); step++) {
+                    bool inside = step < batch.lengths[row];
+                    EXPECT_EQ(batch.mask(step, row, 0), inside);
+                    EXPECT_EQ(batch.tensors[0](step, row, 1), inside ? step + 1 : 0);
+                }
+            }
+            EXPECT_EQ(batch.activeRows(0, 0).shape(), Index({batch.batchSize(), size_t(2)}));
+            EXPECT_EQ(batch.activeRows(1, batch.maxLength() - 1).shape(0),
+                      batch.numActive(batch.maxLength() - 1));
+
+            padded_steps += batch.maxLength() * batch.batchSize();
+            for(size_t length : batch.lengths) {
+                steps += length;
+            }
+        }
+        for(size_t count : visited) {
+            EXPECT_EQ(count, 1);
+        }
+        return double(padded_steps - steps) / padded_steps;
+    };
+
+    // Without pooling, a batch of 16 random lengths is about half padding
+    double unsorted = padding(1);
+    double bucketed = padding(19);
+    EXPECT_GT(unsorted, 0.3);
+    EXPECT_LT(bucketed, 0.1);
+}
+
+struct ClassifierModel : public Module<double>
+{
+    DenseModuleShPtr<double> dense;
+
+    ClassifierModel() { dense = addModule<DenseModule>(6, 4); }
+
+    virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+    {
+        return SoftMax(dense->call(inputs.at(0)));
+    }
+};
+
+TEST(EvaluatorTest, MatchesFullBatch)
+{
+    ClassifierModel model;
+    model.dense->W()->values().uniform(-2, 2);
+
+    Tensor<double> inputs({103, 6});
+    Tensor<double> labels({103});
+    inputs.uniform();
+    for(size_t i = 0; i < 103; i++) {
+        labels(i) = i % 4;
+    }
+
+    // The whole data set at once, with a graph
+    auto encodings = model.call(inputs);
+    auto loss      = SparseCategoricalCrosseEntropy(encodings, Node<double>::create(labels));
+
+    ClassificationMetrics<double> reference(4, 2);
+    reference.update(encodings->values(), labels);
+    EXPECT_NEAR(reference.accuracy(), sparseAccuracy(encodings, labels), 1e-12);
+    EXPECT_NEAR(reference.meanLoss(), loss->value(0) / 103, 1e-12);
+
+    for(size_t num_threads : {1, 4}) {
+        setNumThreads(num_threads);
+        Evaluator<double> evaluator(model, 10);
+        auto metrics = evaluator.evaluate(inputs, labels, ClassificationMetrics<double>(4, 2));
+
+        EXPECT_EQ(metrics.numSamples(), 103);
+        EXPECT_EQ(metrics.accuracy(), reference.accuracy());
+        EXPECT_EQ(metrics.topKAccuracy(), reference.topKAccuracy());
+        EXPECT_NEAR(metrics.meanLoss(), reference.meanLoss(), 1e-12);
+        for(size_t label = 0; label < 4; label++) {
+            for(size_t prediction = 0; prediction < 4; prediction++) {
+                EXPECT_EQ(metrics.confusion(label, prediction),
+                          reference.confusion(label, prediction));
+            }
+        }
+    }
+    EXPECT_GT(reference.topKAccuracy(), reference.accuracy());
+
+    {
+        NoGradGuard no_grad;
+        auto        outputs = model.call(inputs);
+        EXPECT_TRUE(outputs->isLeave());
+        EXPECT_EQ(outputs->gradient().NDims(), 0);
+        EXPECT_EQ(outputs->shape(), Index({103, 4}));
+    }
+    EXPECT_TRUE(gradEnabled());
+    EXPECT_FALSE(model.call(inputs)->isLeave());
+}
+
+TEST(AsyncEvaluatorTest, EvaluatesSnapshot)
+{
+    ClassifierModel model;
+    model.dense->W()->values().uniform(-2, 2);
+
+    Tensor<double> inputs({57, 6});
+    Tensor<double> labels({57});
+    inputs.uniform();
+    for(size_t i = 0; i < 57; i++) {
+        labels(i) = i % 4;
+    }
+
+    ClassifierModel snapshot;
+    snapshot.dense->W()->values() = model.dense->W()->values();
+    snapshot.dense->B()->values() = model.dense->B()->values();
+    auto reference =
+        Evaluator<double>(snapshot, 8).evaluate(inputs, labels, ClassificationMetrics<double>(4));
+
+    std::vector<size_t>                        tags;
+    std::vector<ClassificationMetrics<double>> results;
+    AsyncEvaluator<double, ClassificationMetrics<double>> evaluator(
+        model,
+        [] {
+            return std::make_shared<ClassifierModel>();
+        },
+        inputs, labels, ClassificationMetrics<double>(4),
+        [&](size_t tag, const ClassificationMetrics<double>& metrics) {
+            tags.push_back(tag);
+            results.push_back(metrics);
+        },
+        8);
+
+    // Training goes on while the snapshot is evaluated
+    evaluator.start(1);
+    model.dense->W()->values().uniform(-2, 2);
+    evaluator.start(2);
+    evaluator.wait();
+    EXPECT_FALSE(evaluator.busy());
+
+    ASSERT_EQ(tags, std::vector<size_t>({1, 2}));
+    EXPECT_EQ(results[0].numSamples(), 57);
+    EXPECT_EQ(results[0].accuracy(), reference.accuracy());
+    EXPECT_NEAR(results[0].meanLoss(), reference.meanLoss(), 1e-12);
+
+    auto changed =
+        Evaluator<double>(model, 8).evaluate(inputs, labels, ClassificationMetrics<double>(4));
+    EXPECT_NEAR(results[1].meanLoss(), changed.meanLoss(), 1e-12);
+    EXPECT_NE(results[1].meanLoss(), results[0].meanLoss());
+
+    struct OtherModel : public Module<double>
+    {
+        OtherModel() { addModule<DenseModule>(6, 5); }
+
+        virtual NodeShPtr<double> callHandler(std::vector<NodeShPtr<double>> inputs) override
+        {
+            return inputs.at(0);
+        }
+    };
+    using Async = AsyncEvaluator<double, ClassificationMetrics<double>>;
+    EXPECT_THROW(Async(
+                     model,
+                     [] {
+                         return std::make_shared<OtherModel>();
+                     },
+                     inputs, labels, ClassificationMetrics<double>(4), nullptr),
+                 std::invalid_argument);
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
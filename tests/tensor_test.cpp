@@ -1,4 +1,6 @@
+#include "idx_reader.h"
 #include "tensor.h"
+#include <fstream>
 #include <gtest/gtest-param-test.h>
 #include <gtest/gtest.h>
 #include <iostream>
@@ -429,6 +431,102 @@ TEST(ViewTest, ShrinkTest)
     EXPECT_THROW(t.viewWithNDimsOnTheRight(0), std::invalid_argument);
 }
 
+TEST(ViewTest, ViewOfRange)
+{
+    Tensor<int> buffer({10});
+    buffer.arangeAlongAxis(0, 0, 10);
+
+    Tensor<int> t = buffer.viewOfRange(4, Index{2, 3});
+    EXPECT_EQ(t.shape(), Index({2, 3}));
+    EXPECT_TRUE(t.isContiguous());
+    EXPECT_EQ(t(1, 2), 9);
+
+    // Views of the range keep its offset
+    Tensor<int> flat = t.flatten();
+    EXPECT_EQ(flat(0, 0), 4);
+    flat(0, 5) = -1;
+    EXPECT_EQ(buffer(9), -1);
+
+    EXPECT_THROW(buffer.viewOfRange(8, Index{3}), std::domain_error);
+
+    // Rows are consecutive, parts of each row not
+    Tensor<int> rows({4, 3});
+    EXPECT_TRUE(rows.viewAs(range(1, 3), ellipsis()).isContiguous());
+    EXPECT_FALSE(rows.viewAs(range(0, 4), range(0, 2)).isContiguous());
+}
+
+TEST(ViewTest, GatherRows)
+{
+    Tensor<int> t({5, 2, 3});
+    t.arangeAlongAxis(0, 0, 5);
+
+    Tensor<int> out({3, 2, 3});
+    t.gatherRows({4, 0, 4}, out);
+    for(size_t j = 0; j < 2; j++) {
+        for(size_t k = 0; k < 3; k++) {
+            EXPECT_EQ(out(0, j, k), 4);
+            EXPECT_EQ(out(1, j, k), 0);
+            EXPECT_EQ(out(2, j, k), 4);
+        }
+    }
+
+    // Partial views are gathered element by element
+    Tensor<int> columns = t.viewAs(range(0, 5), range(0, 1), ellipsis());
+    Tensor<int> out_columns({2, 1, 3});
+    columns.gatherRows({3, 1}, out_columns);
+    EXPECT_EQ(out_columns(0, 0, 2), 3);
+    EXPECT_EQ(out_columns(1, 0, 0), 1);
+
+    EXPECT_THROW(t.gatherRows({5}, out_columns), std::invalid_argument);
+    EXPECT_THROW(t.gatherRows({0, 1, 5}, out), std::out_of_range);
+}
+
+TEST(ViewTest, SlidingWindows)
+{
+    Tensor<int> series({10, 2});
+    series.arangeAlongAxis(0, 0, 10);
+    for(size_t step = 0; step < 10; step++) {
+        series(step, 1) = -step;
+    }
+
+    // Windows starting at 0, 3 and 6
+    Tensor<int> windows = series.slidingWindows(4, 3);
+    EXPECT_EQ(windows.shape(), Index({3, 4, 2}));
+    EXPECT_EQ(windows.NElems(), 24);
+    EXPECT_FALSE(windows.isContiguous());
+    EXPECT_TRUE(windows.rowsContiguous());
+    EXPECT_EQ(windows(1, 0, 0), 3);
+    EXPECT_EQ(windows(1, 3, 1), -6);
+    EXPECT_EQ(windows(2, 3, 0), 9);
+
+    // The overlapping elements are shared
+    windows(0, 3, 0) = 42;
+    EXPECT_EQ(windows(1, 0, 0), 42);
+    EXPECT_EQ(series(3, 0), 42);
+    series(3, 0) = 3;
+
+    // Iterating visits every element of every window
+    Tensor<int> copied = windows.copy();
+    EXPECT_TRUE(copied.isContiguous());
+    size_t i = 0;
+    for(int value : copied) {
+        size_t window = i / 8;
+        size_t step   = window * 3 + i % 8 / 2;
+        EXPECT_EQ(value, i % 2 == 0 ? int(step) : -int(step));
+        i++;
+    }
+    EXPECT_EQ(i, 24);
+
+    Tensor<int> rows({2, 4, 2});
+    windows.gatherRows({2, 0}, rows);
+    EXPECT_EQ(rows(0, 2, 0), 8);
+    EXPECT_EQ(rows(1, 2, 1), -2);
+
+    EXPECT_EQ(series.slidingWindows(10, 5).shape(), Index({1, 10, 2}));
+    EXPECT_THROW(series.slidingWindows(11, 1), std::invalid_argument);
+    EXPECT_THROW(series.slidingWindows(2, 0), std::invalid_argument);
+}
+
 TEST(ViewTest, ShrinkToAxis)
 {
     Tensor<int> t({2, 2});
@@ -869,6 +967,40 @@ TEST(InputOutputTest, ToByteTest)
     EXPECT_EQ(a(), b());
 }
 
+TEST(InputOutputTest, IDXTest)
+{
+    {
+        // Two images of 2 x 3 pixels
+        std::ofstream file("test.idx3-ubyte", std::ios::binary);
+        const uint8_t bytes[] = {0, 0, 0x08, 3, 0, 0, 0, 2, 0, 0, 0, 2, 0, 0, 0, 3,
+                                 0, 1, 2, 3, 4, 5, 6, 51, 102, 153, 204, 255};
+        file.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    }
+    Tensor<float> images = readIDX<float>("test.idx3-ubyte", 1.f / 255);
+    EXPECT_EQ(images.shape(), Index({2, 2, 3}));
+    EXPECT_FLOAT_EQ(images(0, 1, 2), 5.f / 255);
+    EXPECT_FLOAT_EQ(images(1, 0, 1), 0.2f);
+    EXPECT_FLOAT_EQ(images(1, 1, 2), 1.f);
+
+    {
+        // Big endian 32 bit integers
+        std::ofstream file("test.idx1-int", std::ios::binary);
+        const uint8_t bytes[] = {0, 0, 0x0C, 1, 0, 0, 0, 2, 0, 0, 1, 2, 0xFF, 0xFF, 0xFF, 0xFE};
+        file.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    }
+    Tensor<double> values = readIDX<double>("test.idx1-int", 1, 0.5);
+    EXPECT_EQ(values.shape(), Index({2}));
+    EXPECT_DOUBLE_EQ(values(0), 258.5);
+    EXPECT_DOUBLE_EQ(values(1), -1.5);
+
+    {
+        std::ofstream file("test.idx1-short", std::ios::binary);
+        const uint8_t bytes[] = {0, 0, 0x08, 1, 0, 0, 0, 3, 1, 2};
+        file.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    }
+    EXPECT_THROW(readIDX<float>("test.idx1-short"), std::runtime_error);
+}
+
 TEST(InputOutputTest, BMPTest)
 {
     Tensor<float> a({128, 128, 3});